@@ -0,0 +1,236 @@
+#pragma once
+
+#include "safe_ptr.hpp"
+
+#include <atomic>
+#include <cstdint>
+
+namespace spl
+{
+
+namespace detail
+{
+    template<typename T>
+    struct atomic_safe_node
+    {
+        safe_ptr<T> value;
+
+        // Readers still using the node after it was unpublished, minus the
+        // ones that had not yet registered with it at that time. The node is
+        // deleted by whoever brings this to zero.
+        std::atomic<long> internal;
+
+        explicit atomic_safe_node(safe_ptr<T>&& v)
+            : value(std::move(v)), internal(0)
+        {
+        }
+    };
+}
+
+//
+// atomic_safe_ptr
+//
+// Holds a safe_ptr that threads may load and replace concurrently, for
+// publishing read-mostly data such as configuration. It can never hold null.
+//
+// The published safe_ptr lives in a node, and the top 16 bits of the word
+// pointing at the node count the readers currently copying out of it (a
+// split reference count). A load is one fetch_add to register, the copy of
+// the safe_ptr, and a compare-and-swap to unregister; no locks are taken.
+// Readers that want to avoid even that should use cached_safe_ptr.
+//
+// Needs a 64-bit platform whose user space addresses fit in 48 bits.
+//
+
+template<typename T>
+class atomic_safe_ptr
+{
+    typedef detail::atomic_safe_node<T> node;
+
+    static_assert(sizeof(std::uintptr_t) == 8, "atomic_safe_ptr needs 64-bit pointers");
+
+    static const std::uintptr_t count_one = std::uintptr_t(1) << 48;
+    static const std::uintptr_t pointer_mask = count_one - 1;
+public:
+    typedef T  element_type;
+
+    explicit atomic_safe_ptr(safe_ptr<T> desired)
+        : word_(pack(new node(std::move(desired)))), version_(0)
+    {
+    }
+
+    ~atomic_safe_ptr()
+    {
+        delete unpack(word_.load(std::memory_order_acquire));
+    }
+
+    safe_ptr<T> load() const
+    {
+        node* n = acquire();
+        safe_ptr<T> result(n->value);
+        release(n);
+        return result;
+    }
+
+    operator safe_ptr<T>() const
+    {
+        return load();
+    }
+
+    void store(safe_ptr<T> desired)
+    {
+        std::uintptr_t old = word_.exchange(pack(new node(std::move(desired))), std::memory_order_acq_rel);
+        version_.fetch_add(1, std::memory_order_release);
+        retire(old, 0);
+    }
+
+    safe_ptr<T> exchange(safe_ptr<T> desired)
+    {
+        std::uintptr_t old = word_.exchange(pack(new node(std::move(desired))), std::memory_order_acq_rel);
+        version_.fetch_add(1, std::memory_order_release);
+        safe_ptr<T> result(unpack(old)->value);
+        retire(old, 0);
+        return result;
+    }
+
+    // Replaces the value with desired if it currently points to the same
+    // object as expected. Otherwise loads the current value into expected.
+    bool compare_exchange_strong(safe_ptr<T>& expected, safe_ptr<T> desired)
+    {
+        node* fresh = 0;
+        for (;;)
+        {
+            node* n = acquire();
+            if (n->value.get() != expected.get())
+            {
+                expected = n->value;
+                release(n);
+                delete fresh;
+                return false;
+            }
+            if (!fresh)
+                fresh = new node(std::move(desired));
+
+            std::uintptr_t w = word_.load(std::memory_order_relaxed);
+            while (unpack(w) == n)
+            {
+                if (word_.compare_exchange_weak(w, pack(fresh), std::memory_order_acq_rel, std::memory_order_relaxed))
+                {
+                    version_.fetch_add(1, std::memory_order_release);
+                    retire(w, 1);
+                    return true;
+                }
+            }
+            release(n);
+        }
+    }
+
+    bool compare_exchange_weak(safe_ptr<T>& expected, safe_ptr<T> desired)
+    {
+        return compare_exchange_strong(expected, std::move(desired));
+    }
+
+    // Incremented by every store, exchange and successful compare_exchange.
+    unsigned long version() const
+    {
+        return version_.load(std::memory_order_acquire);
+    }
+
+    bool is_lock_free() const
+    {
+        return word_.is_lock_free();
+    }
+
+private:
+    atomic_safe_ptr(const atomic_safe_ptr&);
+    atomic_safe_ptr& operator=(const atomic_safe_ptr&);
+
+    static std::uintptr_t pack(node* n)
+    {
+        std::uintptr_t w = reinterpret_cast<std::uintptr_t>(n);
+        assert(!(w & ~pointer_mask) && "node address does not fit in 48 bits");
+        return w;
+    }
+
+    static node* unpack(std::uintptr_t w)
+    {
+        return reinterpret_cast<node*>(w & pointer_mask);
+    }
+
+    node* acquire() const
+    {
+        return unpack(word_.fetch_add(count_one, std::memory_order_acquire));
+    }
+
+    void release(node* n) const
+    {
+        std::uintptr_t w = word_.load(std::memory_order_relaxed);
+        while (unpack(w) == n)
+        {
+            if (word_.compare_exchange_weak(w, w - count_one, std::memory_order_release, std::memory_order_relaxed))
+                return;
+        }
+        // n has been unpublished and our registration moved to n->internal
+        if (n->internal.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            delete n;
+    }
+
+    // Settles the node unpublished from word old. held is 1 when the caller
+    // is one of the readers registered in old and is done with the node.
+    static void retire(std::uintptr_t old, long held)
+    {
+        node* n = unpack(old);
+        long readers = static_cast<long>(old >> 48) - held;
+        if (n->internal.fetch_add(readers, std::memory_order_acq_rel) + readers == 0)
+            delete n;
+    }
+
+    alignas(64) mutable std::atomic<std::uintptr_t> word_;
+    alignas(64) std::atomic<unsigned long> version_;
+};
+
+//
+// cached_safe_ptr
+//
+// A per-thread reader of an atomic_safe_ptr. get() returns the latest
+// published value, and unless something was published since the previous
+// call it only reads the version counter, which stays shared in every
+// reader's cache. That makes steady-state reads wait-free and free of
+// writes to shared memory, so they scale with the number of cores.
+//
+// The returned reference is valid until the next call to get(). A
+// cached_safe_ptr keeps the previous value alive until it sees a new one.
+//
+
+template<typename T>
+class cached_safe_ptr
+{
+public:
+    explicit cached_safe_ptr(const atomic_safe_ptr<T>& source)
+        : source_(&source), version_(source.version()), value_(source.load())
+    {
+    }
+
+    const safe_ptr<T>& get()
+    {
+        unsigned long v = source_->version();
+        if (v != version_)
+        {
+            value_ = source_->load();
+            version_ = v;
+        }
+        return value_;
+    }
+
+    T* operator->()
+    {
+        return get().get();
+    }
+
+private:
+    const atomic_safe_ptr<T>* source_;
+    unsigned long version_;
+    safe_ptr<T> value_;
+};
+
+} // namespace
@@ -0,0 +1,219 @@
+#pragma once
+
+// Minimal benchmark harness shared by the programs in this directory.
+//
+// Every result is printed as one comma separated line:
+//   benchmark,threads,ns_per_op,locked_ops_per_op
+// locked_ops_per_op is empty when the hardware counter is not available.
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace bench
+{
+
+// Keeps the optimizer from discarding a value or hoisting it out of a loop.
+template<class T>
+inline void do_not_optimize(T const& value)
+{
+    asm volatile("" : : "r"(&value) : "memory");
+}
+
+// libstdc++ only uses locked instructions on shared_ptr reference counts once
+// the process has started a second thread. Benchmarks call this first so the
+// numbers reflect what a multi-threaded service pays.
+inline void force_multithreaded()
+{
+    std::thread([]{}).join();
+}
+
+//
+// lock_counter
+//
+// Counts retired locked (atomic read-modify-write) instructions in the
+// calling thread with a raw perf event. The default event is Intel's
+// MEM_INST_RETIRED.LOCK_LOADS; set SPL_BENCH_LOCK_EVENT to a raw event code
+// in hex for other CPUs.
+//
+
+class lock_counter
+{
+public:
+    lock_counter()
+        : fd_(-1)
+    {
+#ifdef __linux__
+        unsigned long long config = 0x21d0;
+        if (const char* env = std::getenv("SPL_BENCH_LOCK_EVENT"))
+            config = std::strtoull(env, 0, 16);
+
+        perf_event_attr attr = perf_event_attr();
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_RAW;
+        attr.config = config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd_ = static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+#endif
+    }
+
+    ~lock_counter()
+    {
+#ifdef __linux__
+        if (fd_ >= 0)
+            close(fd_);
+#endif
+    }
+
+    bool valid() const
+    {
+        return fd_ >= 0;
+    }
+
+    void start()
+    {
+#ifdef __linux__
+        if (valid())
+        {
+            ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+
+    long long stop()
+    {
+        long long count = 0;
+#ifdef __linux__
+        if (valid())
+        {
+            ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0);
+            if (read(fd_, &count, sizeof(count)) != sizeof(count))
+                count = 0;
+        }
+#endif
+        return count;
+    }
+
+private:
+    lock_counter(const lock_counter&);
+    lock_counter& operator=(const lock_counter&);
+
+    int fd_;
+};
+
+struct result
+{
+    double ns_per_op;
+    double locked_ops_per_op; // negative when not measured
+};
+
+inline void report(const char* name, unsigned threads, result r)
+{
+    if (r.locked_ops_per_op < 0)
+        std::printf("%s,%u,%.2f,\n", name, threads, r.ns_per_op);
+    else
+        std::printf("%s,%u,%.2f,%.2f\n", name, threads, r.ns_per_op, r.locked_ops_per_op);
+    std::fflush(stdout);
+}
+
+inline void print_header()
+{
+    std::printf("benchmark,threads,ns_per_op,locked_ops_per_op\n");
+}
+
+// Runs op(i) for i in [0, iterations) on the calling thread.
+template<class Op>
+result measure(long iterations, Op op)
+{
+    for (long i = 0; i < iterations / 10; ++i)
+        op(i);
+
+    lock_counter locks;
+    locks.start();
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    for (long i = 0; i < iterations; ++i)
+        op(i);
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    long long locked = locks.stop();
+
+    result r;
+    r.ns_per_op = std::chrono::duration<double, std::nano>(end - begin).count() / iterations;
+    r.locked_ops_per_op = locks.valid() ? double(locked) / iterations : -1.0;
+    return r;
+}
+
+template<class Op>
+void run(const char* name, long iterations, Op op)
+{
+    report(name, 1, measure(iterations, op));
+}
+
+// Runs op(thread, i) for i in [0, iterations) on threads threads at once.
+// ns_per_op is the wall time divided by iterations, i.e. the cost of one op
+// as seen by each thread; it stays flat when an operation scales perfectly.
+template<class Op>
+result measure_threads(unsigned threads, long iterations, Op op)
+{
+    std::atomic<unsigned> ready(0);
+    std::atomic<bool> go(false);
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < threads; ++t)
+    {
+        workers.push_back(std::thread([&, t]() {
+            for (long i = 0; i < iterations / 10; ++i)
+                op(t, i);
+            ++ready;
+            while (!go.load())
+                std::this_thread::yield();
+            for (long i = 0; i < iterations; ++i)
+                op(t, i);
+        }));
+    }
+
+    while (ready.load() != threads)
+        std::this_thread::yield();
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    go = true;
+    for (unsigned t = 0; t < threads; ++t)
+        workers[t].join();
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+    result r;
+    r.ns_per_op = std::chrono::duration<double, std::nano>(end - begin).count() / iterations;
+    r.locked_ops_per_op = -1.0;
+    return r;
+}
+
+template<class Op>
+void run_threads(const char* name, unsigned threads, long iterations, Op op)
+{
+    report(name, threads, measure_threads(threads, iterations, op));
+}
+
+// 1, 2, 4, ... up to the number of hardware threads.
+inline std::vector<unsigned> thread_counts()
+{
+    unsigned max = std::thread::hardware_concurrency();
+    if (max == 0)
+        max = 1;
+    std::vector<unsigned> counts;
+    for (unsigned n = 1; n < max; n *= 2)
+        counts.push_back(n);
+    counts.push_back(max);
+    return counts;
+}
+
+} // namespace bench
@@ -0,0 +1,81 @@
+// Read throughput of an object while other threads copy and release
+// safe_ptrs to it, for make_safe (reference counts and object on one cache
+// line) against make_safe_aligned (on separate lines). Half the hardware
+// threads read, the other half copy; with a single hardware thread there is
+// no sharing to measure and the two should match.
+
+#include "bench.hpp"
+
+#include "safe_aligned.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace spl;
+
+namespace
+{
+
+struct quote
+{
+    long bid;
+    long ask;
+
+    quote() : bid(100), ask(101) {}
+};
+
+const long reads = 20000000;
+
+// ns per read on each reader while copiers hammer the reference count.
+void read_while_copying(const std::string& name, const safe_ptr<quote>& q, unsigned readers, unsigned copiers)
+{
+    std::atomic<bool> stop(false);
+    std::vector<std::thread> copying;
+    for (unsigned t = 0; t < copiers; ++t)
+    {
+        copying.push_back(std::thread([&]() {
+            while (!stop.load(std::memory_order_relaxed))
+            {
+                safe_ptr<quote> copy(q);
+                bench::do_not_optimize(copy);
+            }
+        }));
+    }
+
+    const quote* object = q.get();
+    bench::result r = bench::measure_threads(readers, reads, [object](unsigned, long) {
+        long spread = object->ask - object->bid;
+        bench::do_not_optimize(spread);
+        asm volatile("" : : : "memory");
+    });
+
+    stop = true;
+    for (unsigned t = 0; t < copying.size(); ++t)
+        copying[t].join();
+    bench::report(name.c_str(), readers + copiers, r);
+}
+
+}
+
+int main()
+{
+    bench::force_multithreaded();
+    bench::print_header();
+
+    unsigned threads = std::max(2u, std::thread::hardware_concurrency());
+    unsigned readers = threads / 2;
+    unsigned copiers = threads - readers;
+
+    safe_ptr<quote> packed = make_safe<quote>();
+    safe_ptr<quote> aligned = make_safe_aligned<quote>();
+
+    read_while_copying("make_safe/read_idle", packed, readers, 0);
+    read_while_copying("make_safe/read_while_copying", packed, readers, copiers);
+    read_while_copying("make_safe_aligned/read_idle", aligned, readers, 0);
+    read_while_copying("make_safe_aligned/read_while_copying", aligned, readers, copiers);
+
+    return 0;
+}
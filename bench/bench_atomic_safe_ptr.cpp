@@ -0,0 +1,113 @@
+#include "bench.hpp"
+
+#include "atomic_safe_ptr.hpp"
+
+#include <mutex>
+#include <vector>
+
+using namespace spl;
+
+namespace
+{
+
+struct config
+{
+    int routes[16];
+};
+
+const long iterations = 2000000;
+
+// Replaces the published config about every millisecond while readers run.
+class writer
+{
+public:
+    template<class Publish>
+    explicit writer(Publish publish)
+        : done_(false)
+    {
+        thread_ = std::thread([this, publish]() {
+            while (!done_.load())
+            {
+                publish();
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        });
+    }
+
+    ~writer()
+    {
+        done_ = true;
+        thread_.join();
+    }
+
+private:
+    std::atomic<bool> done_;
+    std::thread thread_;
+};
+
+}
+
+int main()
+{
+    bench::print_header();
+
+    std::vector<unsigned> counts = bench::thread_counts();
+    for (size_t c = 0; c < counts.size(); ++c)
+    {
+        unsigned threads = counts[c];
+
+        {
+            std::mutex mutex;
+            safe_ptr<const config> published(make_safe<config>());
+            writer w([&]() {
+                safe_ptr<const config> fresh(make_safe<config>());
+                std::lock_guard<std::mutex> lock(mutex);
+                published = fresh;
+            });
+            bench::run_threads("mutex_load", threads, iterations, [&](unsigned, long) {
+                std::unique_lock<std::mutex> lock(mutex);
+                safe_ptr<const config> c(published);
+                lock.unlock();
+                bench::do_not_optimize(c->routes[0]);
+            });
+        }
+
+        {
+            std::shared_ptr<const config> published(std::make_shared<config>());
+            writer w([&]() {
+                std::atomic_store(&published, std::shared_ptr<const config>(std::make_shared<config>()));
+            });
+            bench::run_threads("std_atomic_load_shared_ptr", threads, iterations, [&](unsigned, long) {
+                std::shared_ptr<const config> c = std::atomic_load(&published);
+                bench::do_not_optimize(c->routes[0]);
+            });
+        }
+
+        {
+            atomic_safe_ptr<const config> published(make_safe<config>());
+            writer w([&]() {
+                published.store(make_safe<config>());
+            });
+            bench::run_threads("atomic_safe_ptr_load", threads, iterations, [&](unsigned, long) {
+                safe_ptr<const config> c = published.load();
+                bench::do_not_optimize(c->routes[0]);
+            });
+        }
+
+        {
+            atomic_safe_ptr<const config> published(make_safe<config>());
+            writer w([&]() {
+                published.store(make_safe<config>());
+            });
+            std::vector<std::unique_ptr<cached_safe_ptr<const config> > > readers;
+            for (unsigned t = 0; t < threads; ++t)
+                readers.push_back(std::unique_ptr<cached_safe_ptr<const config> >(new cached_safe_ptr<const config>(published)));
+            bench::run_threads("cached_safe_ptr_get", threads, iterations, [&](unsigned t, long) {
+                const safe_ptr<const config>& c = readers[t]->get();
+                bench::do_not_optimize(c->routes[0]);
+            });
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,59 @@
+// Copy throughput of biased_safe_ptr against safe_ptr: on the thread that
+// made the object, where biased_safe_ptr uses a plain counter, and on other
+// threads, where both use atomic operations.
+
+#include "bench.hpp"
+
+#include "biased_safe_ptr.hpp"
+
+#include <vector>
+
+using namespace spl;
+
+namespace
+{
+
+struct session
+{
+    long id;
+
+    session() : id(42) {}
+};
+
+const long iterations = 20000000;
+
+}
+
+int main()
+{
+    bench::force_multithreaded();
+    bench::print_header();
+
+    safe_ptr<session> s = make_safe<session>();
+    biased_safe_ptr<session> b = make_biased_safe<session>();
+
+    bench::run("safe_ptr/copy_owner", iterations, [&](long) {
+        safe_ptr<session> p(s);
+        bench::do_not_optimize(p);
+    });
+    bench::run("biased_safe_ptr/copy_owner", iterations, [&](long) {
+        biased_safe_ptr<session> p(b);
+        bench::do_not_optimize(p);
+    });
+
+    // copies of one object from other threads
+    std::vector<unsigned> counts = bench::thread_counts();
+    for (std::size_t i = 0; i < counts.size(); ++i)
+    {
+        bench::run_threads("safe_ptr/copy_other_threads", counts[i], iterations / 4, [&](unsigned, long) {
+            safe_ptr<session> p(s);
+            bench::do_not_optimize(p);
+        });
+        bench::run_threads("biased_safe_ptr/copy_other_threads", counts[i], iterations / 4, [&](unsigned, long) {
+            biased_safe_ptr<session> p(b);
+            bench::do_not_optimize(p);
+        });
+    }
+
+    return 0;
+}
@@ -0,0 +1,90 @@
+#include "bench.hpp"
+
+#include "safe_ptr.hpp"
+
+using namespace spl;
+
+namespace
+{
+
+struct message
+{
+    virtual ~message() {}
+    int kind;
+};
+
+struct order : message
+{
+    int quantity;
+};
+
+const long iterations = 10000000;
+
+// What spl::static_pointer_cast did before it aliased the source directly.
+template <class T, class U>
+safe_ptr<T> legacy_static_pointer_cast(const safe_ptr<U>& p)
+{
+    return safe_ptr<T>(std::static_pointer_cast<T>(std::shared_ptr<U>(p)));
+}
+
+template <class T, class U>
+safe_ptr<T> legacy_dynamic_pointer_cast(const safe_ptr<U>& p)
+{
+    auto temp = std::dynamic_pointer_cast<T>(std::shared_ptr<U>(p));
+    if(!temp)
+        throw std::bad_cast();
+    return safe_ptr<T>(std::move(temp));
+}
+
+}
+
+int main()
+{
+    bench::force_multithreaded();
+    bench::print_header();
+
+    std::shared_ptr<message> shared = std::make_shared<order>();
+    safe_ptr<message> msg(make_safe<order>());
+
+    bench::run("std_static_pointer_cast", iterations, [&](long) {
+        bench::do_not_optimize(std::static_pointer_cast<order>(shared));
+    });
+    bench::run("legacy_static_pointer_cast", iterations, [&](long) {
+        bench::do_not_optimize(legacy_static_pointer_cast<order>(msg));
+    });
+    bench::run("static_pointer_cast_lvalue", iterations, [&](long) {
+        bench::do_not_optimize(static_pointer_cast<order>(msg));
+    });
+    bench::run("static_pointer_cast_rvalue", iterations, [&](long) {
+        safe_ptr<order> o = static_pointer_cast<order>(std::move(msg));
+        msg = std::move(o);
+        bench::do_not_optimize(msg);
+    });
+
+    bench::run("std_dynamic_pointer_cast", iterations, [&](long) {
+        bench::do_not_optimize(std::dynamic_pointer_cast<order>(shared));
+    });
+    bench::run("legacy_dynamic_pointer_cast", iterations, [&](long) {
+        bench::do_not_optimize(legacy_dynamic_pointer_cast<order>(msg));
+    });
+    bench::run("dynamic_pointer_cast_lvalue", iterations, [&](long) {
+        bench::do_not_optimize(dynamic_pointer_cast<order>(msg));
+    });
+    bench::run("dynamic_pointer_cast_rvalue", iterations, [&](long) {
+        safe_ptr<order> o = dynamic_pointer_cast<order>(std::move(msg));
+        msg = std::move(o);
+        bench::do_not_optimize(msg);
+    });
+
+    bench::run("aliasing_constructor_lvalue", iterations, [&](long) {
+        bench::do_not_optimize(safe_ptr<int>(msg, &msg->kind));
+    });
+    message* raw = msg.get();
+    bench::run("aliasing_constructor_rvalue", iterations, [&](long) {
+        safe_ptr<int> k(std::move(msg), &raw->kind);
+        msg = safe_ptr<message>(std::move(k), raw);
+        bench::do_not_optimize(msg);
+    });
+
+    return 0;
+}
@@ -0,0 +1,101 @@
+#include "bench.hpp"
+
+#include "fast_cast.hpp"
+
+#include <string>
+#include <vector>
+
+using namespace spl;
+
+namespace
+{
+
+// A chain of deep_depth classes below the root, each registered with its
+// parent.
+const int deep_depth = 8;
+
+template<int N>
+struct deep : deep<N - 1>
+{
+    SPL_FAST_CAST(deep, deep<N - 1>)
+};
+
+template<>
+struct deep<0> : fast_castable
+{
+};
+
+// wide_width siblings below one base.
+const int wide_width = 16;
+
+struct wide_base : fast_castable
+{
+};
+
+template<int N>
+struct wide : wide_base
+{
+    SPL_FAST_CAST(wide, wide_base)
+};
+
+template<int N>
+void add_wide(std::vector<safe_ptr<wide_base> >& v)
+{
+    v.push_back(make_safe<wide<N> >());
+    add_wide<N - 1>(v);
+}
+
+template<>
+void add_wide<-1>(std::vector<safe_ptr<wide_base> >&)
+{
+}
+
+const long iterations = 5000000;
+
+// Casts the objects in turn to T, with and without taking a reference.
+template<class T, class U>
+void run_pair(const char* name, const std::vector<safe_ptr<U> >& objects)
+{
+    std::string raw = std::string("dynamic_cast/") + name;
+    bench::run(raw.c_str(), iterations, [&](long i) {
+        bench::do_not_optimize(dynamic_cast<T*>(objects[i % objects.size()].get()));
+    });
+    std::string raw_fast = std::string("fast_dynamic_cast/") + name;
+    bench::run(raw_fast.c_str(), iterations, [&](long i) {
+        bench::do_not_optimize(fast_dynamic_cast<T>(objects[i % objects.size()].get()));
+    });
+    std::string rtti = std::string("try_dynamic_pointer_cast/") + name;
+    bench::run(rtti.c_str(), iterations, [&](long i) {
+        bench::do_not_optimize(try_dynamic_pointer_cast<T>(objects[i % objects.size()]));
+    });
+    std::string fast = std::string("try_fast_dynamic_pointer_cast/") + name;
+    bench::run(fast.c_str(), iterations, [&](long i) {
+        bench::do_not_optimize(try_fast_dynamic_pointer_cast<T>(objects[i % objects.size()]));
+    });
+}
+
+}
+
+int main()
+{
+    bench::force_multithreaded();
+    bench::print_header();
+
+    std::vector<safe_ptr<deep<0> > > chain;
+    for (int i = 0; i < 64; ++i)
+        chain.push_back(make_safe<deep<deep_depth> >());
+    run_pair<deep<deep_depth> >("deep_to_leaf", chain);
+    run_pair<deep<deep_depth / 2> >("deep_to_middle", chain);
+
+    std::vector<safe_ptr<deep<0> > > shallow;
+    for (int i = 0; i < 64; ++i)
+        shallow.push_back(make_safe<deep<1> >());
+    run_pair<deep<deep_depth> >("deep_miss", shallow);
+
+    std::vector<safe_ptr<wide_base> > siblings;
+    for (int i = 0; i < 4; ++i)
+        add_wide<wide_width - 1>(siblings);
+    run_pair<wide<0> >("wide_1_in_16", siblings);
+
+    return 0;
+}
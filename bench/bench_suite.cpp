@@ -0,0 +1,350 @@
+// Cost of every common safe_ptr operation next to the same operation on
+// std::shared_ptr and on a raw pointer, first on one thread and then with
+// all hardware threads hammering either one shared object (contended) or an
+// object each (uncontended).
+//
+// Benchmark names are <pointer>/<operation>. An optional argument restricts
+// the run to benchmarks whose name contains it, e.g.
+//   bench_suite safe_ptr/
+//   bench_suite /copy
+
+#include "bench.hpp"
+
+#include "safe_ptr.hpp"
+#include "safe_ptr_vector.hpp"
+
+#include <algorithm>
+#include <string>
+
+using namespace spl;
+
+namespace
+{
+
+struct widget : enable_safe_from_this<widget>
+{
+    virtual ~widget() {}
+    int value;
+};
+
+struct gadget : widget
+{
+    int extra;
+};
+
+struct plain_widget : std::enable_shared_from_this<plain_widget>
+{
+    virtual ~plain_widget() {}
+    int value;
+};
+
+struct plain_gadget : plain_widget
+{
+    int extra;
+};
+
+const long iterations = 5000000;
+const long container_iterations = 20000;
+const std::size_t container_size = 1000;
+
+const char* filter = 0;
+
+bool selected(const std::string& name)
+{
+    return !filter || name.find(filter) != std::string::npos;
+}
+
+template<class Op>
+void run(const std::string& name, long n, Op op)
+{
+    if (selected(name))
+        bench::run(name.c_str(), n, op);
+}
+
+template<class Op>
+void run_threads(const std::string& name, long n, Op op)
+{
+    if (!selected(name))
+        return;
+    std::vector<unsigned> counts = bench::thread_counts();
+    for (std::size_t i = 0; i < counts.size(); ++i)
+        bench::run_threads(name.c_str(), counts[i], n, op);
+}
+
+void raw_pointers()
+{
+    const std::string prefix = "raw/";
+    widget* w = new gadget();
+    widget* other = new gadget();
+
+    run(prefix + "construct", iterations, [&](long) {
+        widget* p = new gadget();
+        bench::do_not_optimize(p);
+        delete p;
+    });
+    run(prefix + "copy", iterations, [&](long) {
+        widget* p = w;
+        bench::do_not_optimize(p);
+    });
+    run(prefix + "assign", iterations, [&](long i) {
+        widget* p = w;
+        p = (i & 1) ? w : other;
+        bench::do_not_optimize(p);
+    });
+    run(prefix + "static_cast", iterations, [&](long) {
+        bench::do_not_optimize(static_cast<gadget*>(w));
+    });
+    run(prefix + "dynamic_cast", iterations, [&](long) {
+        bench::do_not_optimize(dynamic_cast<gadget*>(w));
+    });
+    run(prefix + "const_cast", iterations, [&](long) {
+        const widget* c = w;
+        bench::do_not_optimize(const_cast<widget*>(c));
+    });
+    run(prefix + "deref", iterations, [&](long) {
+        bench::do_not_optimize(w->value);
+    });
+
+    std::vector<widget*> v(container_size, w);
+    run(prefix + "vector_copy", container_iterations, [&](long) {
+        std::vector<widget*> c(v);
+        bench::do_not_optimize(c);
+    });
+    run(prefix + "vector_push_back", container_iterations, [&](long) {
+        std::vector<widget*> c;
+        for (std::size_t j = 0; j < container_size; ++j)
+            c.push_back(w);
+        bench::do_not_optimize(c);
+    });
+    run(prefix + "vector_sort", container_iterations, [&](long) {
+        std::vector<widget*> c;
+        for (std::size_t j = 0; j < container_size; ++j)
+            c.push_back((j * 7919) & 1 ? w : other);
+        std::sort(c.begin(), c.end());
+        bench::do_not_optimize(c);
+    });
+
+    delete w;
+    delete other;
+}
+
+void shared_pointers()
+{
+    const std::string prefix = "shared_ptr/";
+    std::shared_ptr<plain_widget> w = std::make_shared<plain_gadget>();
+    std::shared_ptr<plain_widget> other = std::make_shared<plain_gadget>();
+
+    run(prefix + "construct", iterations, [&](long) {
+        bench::do_not_optimize(std::shared_ptr<plain_widget>(new plain_gadget()));
+    });
+    run(prefix + "make", iterations, [&](long) {
+        bench::do_not_optimize(std::make_shared<plain_gadget>());
+    });
+    run(prefix + "copy", iterations, [&](long) {
+        std::shared_ptr<plain_widget> p(w);
+        bench::do_not_optimize(p);
+    });
+    run(prefix + "move", iterations, [&](long) {
+        std::shared_ptr<plain_widget> p(std::move(w));
+        w = std::move(p);
+        bench::do_not_optimize(w);
+    });
+    run(prefix + "assign", iterations, [&](long i) {
+        std::shared_ptr<plain_widget> p(w);
+        p = (i & 1) ? w : other;
+        bench::do_not_optimize(p);
+    });
+    run(prefix + "static_cast", iterations, [&](long) {
+        bench::do_not_optimize(std::static_pointer_cast<plain_gadget>(w));
+    });
+    run(prefix + "dynamic_cast", iterations, [&](long) {
+        bench::do_not_optimize(std::dynamic_pointer_cast<plain_gadget>(w));
+    });
+    run(prefix + "const_cast", iterations, [&](long) {
+        std::shared_ptr<const plain_widget> c(w);
+        bench::do_not_optimize(std::const_pointer_cast<plain_widget>(c));
+    });
+    run(prefix + "from_this", iterations, [&](long) {
+        bench::do_not_optimize(w->shared_from_this());
+    });
+    std::weak_ptr<plain_widget> weak(w);
+    run(prefix + "weak_lock", iterations, [&](long) {
+        bench::do_not_optimize(weak.lock());
+    });
+    run(prefix + "deref", iterations, [&](long) {
+        bench::do_not_optimize(w->value);
+    });
+
+    std::vector<std::shared_ptr<plain_widget> > v(container_size, w);
+    run(prefix + "vector_copy", container_iterations, [&](long) {
+        std::vector<std::shared_ptr<plain_widget> > c(v);
+        bench::do_not_optimize(c);
+    });
+    run(prefix + "vector_push_back", container_iterations, [&](long) {
+        std::vector<std::shared_ptr<plain_widget> > c;
+        for (std::size_t j = 0; j < container_size; ++j)
+            c.push_back(w);
+        bench::do_not_optimize(c);
+    });
+    run(prefix + "vector_sort", container_iterations, [&](long) {
+        std::vector<std::shared_ptr<plain_widget> > c;
+        for (std::size_t j = 0; j < container_size; ++j)
+            c.push_back((j * 7919) & 1 ? w : other);
+        std::sort(c.begin(), c.end());
+        bench::do_not_optimize(c);
+    });
+
+    std::vector<std::shared_ptr<plain_widget> > own;
+    for (unsigned t = 0; t < std::max(1u, std::thread::hardware_concurrency()); ++t)
+        own.push_back(std::make_shared<plain_gadget>());
+    run_threads(prefix + "copy_contended", iterations, [&](unsigned, long) {
+        std::shared_ptr<plain_widget> p(w);
+        bench::do_not_optimize(p);
+    });
+    run_threads(prefix + "copy_uncontended", iterations, [&](unsigned t, long) {
+        std::shared_ptr<plain_widget> p(own[t]);
+        bench::do_not_optimize(p);
+    });
+    run_threads(prefix + "make_concurrent", iterations / 4, [&](unsigned, long) {
+        bench::do_not_optimize(std::make_shared<plain_gadget>());
+    });
+}
+
+void safe_pointers()
+{
+    const std::string prefix = "safe_ptr/";
+    safe_ptr<widget> w(make_safe<gadget>());
+    safe_ptr<widget> other(make_safe<gadget>());
+
+    run(prefix + "construct", iterations, [&](long) {
+        bench::do_not_optimize(safe_ptr<widget>(new gadget()));
+    });
+    run(prefix + "make", iterations, [&](long) {
+        bench::do_not_optimize(make_safe<gadget>());
+    });
+    run(prefix + "copy", iterations, [&](long) {
+        safe_ptr<widget> p(w);
+        bench::do_not_optimize(p);
+    });
+    run(prefix + "move", iterations, [&](long) {
+        safe_ptr<widget> p(std::move(w));
+        w = std::move(p);
+        bench::do_not_optimize(w);
+    });
+    run(prefix + "assign", iterations, [&](long i) {
+        safe_ptr<widget> p(w);
+        p = (i & 1) ? w : other;
+        bench::do_not_optimize(p);
+    });
+    run(prefix + "static_cast", iterations, [&](long) {
+        bench::do_not_optimize(static_pointer_cast<gadget>(w));
+    });
+    run(prefix + "dynamic_cast", iterations, [&](long) {
+        bench::do_not_optimize(dynamic_pointer_cast<gadget>(w));
+    });
+    run(prefix + "const_cast", iterations, [&](long) {
+        safe_ptr<const widget> c(w);
+        bench::do_not_optimize(const_pointer_cast<widget>(c));
+    });
+    run(prefix + "from_this", iterations, [&](long) {
+        bench::do_not_optimize(w->safe_from_this());
+    });
+    weak_safe_ptr<widget> weak(w);
+    run(prefix + "weak_lock", iterations, [&](long) {
+        bench::do_not_optimize(weak.lock());
+    });
+    std::weak_ptr<widget> std_weak(w);
+    run(prefix + "weak_lock_throwing", iterations, [&](long) {
+        bench::do_not_optimize(safe_ptr<widget>(std_weak.lock()));
+    });
+    run(prefix + "deref", iterations, [&](long) {
+        bench::do_not_optimize(w->value);
+    });
+    run(prefix + "to_shared", iterations, [&](long) {
+        bench::do_not_optimize(std::shared_ptr<widget>(w));
+    });
+
+    std::vector<safe_ptr<widget> > v(container_size, w);
+    run(prefix + "vector_copy", container_iterations, [&](long) {
+        std::vector<safe_ptr<widget> > c(v);
+        bench::do_not_optimize(c);
+    });
+    run(prefix + "vector_push_back", container_iterations, [&](long) {
+        std::vector<safe_ptr<widget> > c;
+        for (std::size_t j = 0; j < container_size; ++j)
+            c.push_back(w);
+        bench::do_not_optimize(c);
+    });
+    run(prefix + "vector_sort", container_iterations, [&](long) {
+        std::vector<safe_ptr<widget> > c;
+        for (std::size_t j = 0; j < container_size; ++j)
+            c.push_back((j * 7919) & 1 ? w : other);
+        std::sort(c.begin(), c.end());
+        bench::do_not_optimize(c);
+    });
+
+    run(prefix + "vector_insert_front", container_iterations / 10, [&](long) {
+        std::vector<safe_ptr<widget> > c;
+        for (std::size_t j = 0; j < container_size; ++j)
+            c.insert(c.begin(), w);
+        bench::do_not_optimize(c);
+    });
+    run("safe_ptr_vector/push_back", container_iterations, [&](long) {
+        safe_ptr_vector<widget> c;
+        for (std::size_t j = 0; j < container_size; ++j)
+            c.push_back(w);
+        bench::do_not_optimize(c);
+    });
+    run("safe_ptr_vector/insert_front", container_iterations / 10, [&](long) {
+        safe_ptr_vector<widget> c;
+        for (std::size_t j = 0; j < container_size; ++j)
+            c.insert(c.begin(), w);
+        bench::do_not_optimize(c);
+    });
+    run("safe_ptr_vector/sort", container_iterations, [&](long) {
+        safe_ptr_vector<widget> c;
+        for (std::size_t j = 0; j < container_size; ++j)
+            c.push_back((j * 7919) & 1 ? w : other);
+        c.sort();
+        bench::do_not_optimize(c);
+    });
+
+    std::vector<safe_ptr<widget> > own;
+    for (unsigned t = 0; t < std::max(1u, std::thread::hardware_concurrency()); ++t)
+        own.push_back(make_safe<gadget>());
+    run_threads(prefix + "copy_contended", iterations, [&](unsigned, long) {
+        safe_ptr<widget> p(w);
+        bench::do_not_optimize(p);
+    });
+    run_threads(prefix + "copy_uncontended", iterations, [&](unsigned t, long) {
+        safe_ptr<widget> p(own[t]);
+        bench::do_not_optimize(p);
+    });
+    run_threads(prefix + "make_concurrent", iterations / 4, [&](unsigned, long) {
+        bench::do_not_optimize(make_safe<gadget>());
+    });
+
+    static gadget global;
+    safe_ptr<widget> s(static_safe_ptr<widget>(global));
+    run_threads("static_safe_ptr/copy_contended", iterations, [&](unsigned, long) {
+        safe_ptr<widget> p(s);
+        bench::do_not_optimize(p);
+    });
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc > 1)
+        filter = argv[1];
+
+    bench::force_multithreaded();
+    bench::print_header();
+
+    raw_pointers();
+    shared_pointers();
+    safe_pointers();
+
+    return 0;
+}
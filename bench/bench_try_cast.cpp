@@ -0,0 +1,82 @@
+#include "bench.hpp"
+
+#include "safe_ptr.hpp"
+
+#include <cstdio>
+#include <vector>
+
+using namespace spl;
+
+namespace
+{
+
+struct event
+{
+    virtual ~event() {}
+};
+
+struct trade : event
+{
+    int price;
+};
+
+struct quote : event
+{
+};
+
+const long iterations = 2000000;
+
+// Routes events using the throwing cast; returns how many were trades.
+long route_throwing(const std::vector<safe_ptr<event> >& events, long i)
+{
+    try
+    {
+        safe_ptr<trade> t = dynamic_pointer_cast<trade>(events[i % events.size()]);
+        bench::do_not_optimize(t);
+        return 1;
+    }
+    catch (std::bad_cast&)
+    {
+        return 0;
+    }
+}
+
+long route_try(const std::vector<safe_ptr<event> >& events, long i)
+{
+    maybe_safe_ptr<trade> t = try_dynamic_pointer_cast<trade>(events[i % events.size()]);
+    bench::do_not_optimize(t);
+    return t ? 1 : 0;
+}
+
+}
+
+int main()
+{
+    bench::force_multithreaded();
+    bench::print_header();
+
+    const int miss_percents[] = { 0, 1, 10, 50, 90 };
+    for (unsigned m = 0; m < sizeof(miss_percents) / sizeof(miss_percents[0]); ++m)
+    {
+        std::vector<safe_ptr<event> > events;
+        for (int i = 0; i < 100; ++i)
+        {
+            if (i < miss_percents[m])
+                events.push_back(make_safe<quote>());
+            else
+                events.push_back(make_safe<trade>());
+        }
+
+        char name[64];
+        std::snprintf(name, sizeof(name), "dynamic_pointer_cast_miss_%d%%", miss_percents[m]);
+        bench::run(name, iterations, [&](long i) {
+            bench::do_not_optimize(route_throwing(events, i));
+        });
+        std::snprintf(name, sizeof(name), "try_dynamic_pointer_cast_miss_%d%%", miss_percents[m]);
+        bench::run(name, iterations, [&](long i) {
+            bench::do_not_optimize(route_try(events, i));
+        });
+    }
+
+    return 0;
+}
@@ -0,0 +1,128 @@
+#!/bin/sh
+#
+# Measures what make_safe costs the compiler: front end time over a
+# generated translation unit that calls make_safe for N types with 0 to M-1
+# arguments each, and the number of spl functions that end up instantiated.
+# Every other type has its own T::make_safe hook.
+#
+# usage: compile_time.sh [-n types] [-m arities] [-r runs] [-s std] [-p] [header_dir...]
+#
+#   -p   also time a build that picks up a precompiled safe_ptr.hpp
+#
+# header_dir defaults to the repository root. To compare against another
+# version of the header, check it out somewhere and pass both, e.g.
+#   mkdir /tmp/old && git show HEAD~1:safe_ptr.hpp > /tmp/old/safe_ptr.hpp
+#   ./compile_time.sh .. /tmp/old
+#
+# Prints one comma separated line per header_dir and mode:
+#   header_dir,std,mode,types,arities,seconds,instantiations
+#
+# seconds is the best of runs. instantiations counts the spl functions
+# emitted into an -O0 object.
+
+set -e
+
+CXX=${CXX:-c++}
+types=64
+arities=6
+runs=3
+std=c++17
+pch=
+
+while getopts n:m:r:s:p opt
+do
+    case $opt in
+        n) types=$OPTARG ;;
+        m) arities=$OPTARG ;;
+        r) runs=$OPTARG ;;
+        s) std=$OPTARG ;;
+        p) pch=1 ;;
+        *) sed -n '8,10p' "$0" >&2; exit 2 ;;
+    esac
+done
+shift $((OPTIND - 1))
+[ $# -gt 0 ] || set -- "$(dirname "$0")/.."
+
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+# the generated translation unit
+{
+    echo '#include "safe_ptr.hpp"'
+    echo 'void use(const void*);'
+    i=0
+    while [ $i -lt "$types" ]
+    do
+        echo "struct type$i"
+        echo "{"
+        echo "    template<class... Args> type$i(Args...) {}"
+        if [ $((i % 2)) -eq 1 ]
+        then
+            echo "    template<class... Args> static spl::safe_ptr<type$i> make_safe(Args&&... args)"
+            echo "    { return spl::safe_ptr<type$i>(new type$i(args...)); }"
+        fi
+        echo "};"
+        i=$((i + 1))
+    done
+    echo "void calls()"
+    echo "{"
+    i=0
+    while [ $i -lt "$types" ]
+    do
+        a=0
+        args=
+        while [ $a -lt "$arities" ]
+        do
+            echo "    use(spl::make_safe<type$i>($args).get());"
+            args="$args${args:+, }$a"
+            a=$((a + 1))
+        done
+        i=$((i + 1))
+    done
+    echo "}"
+} > "$work/calls.cpp"
+
+now()
+{
+    date +%s.%N
+}
+
+# best wall clock time of $runs runs of the given command
+best_of()
+{
+    best=
+    n=0
+    while [ $n -lt "$runs" ]
+    do
+        start=$(now)
+        "$@"
+        end=$(now)
+        best=$(echo "$start $end ${best:-0}" | awk '{ t = $2 - $1; if ($3 == 0 || t < $3) print t; else print $3 }')
+        n=$((n + 1))
+    done
+    echo "$best"
+}
+
+instantiations()
+{
+    "$CXX" -std="$std" -O0 -c "$@" "$work/calls.cpp" -o "$work/calls.o"
+    nm -C --defined-only "$work/calls.o" | grep -c ' spl::' || true
+}
+
+for dir in "$@"
+do
+    dir=$(cd "$dir" && pwd)
+    count=$(instantiations -I"$dir")
+    seconds=$(best_of "$CXX" -std="$std" -fsyntax-only -I"$dir" "$work/calls.cpp")
+    echo "$dir,$std,header,$types,$arities,$seconds,$count"
+
+    if [ -n "$pch" ]
+    then
+        # gcc and clang both take dir/safe_ptr.hpp.gch in place of the header
+        # when it comes first on the include path and the flags match
+        rm -rf "$work/pch" && mkdir "$work/pch"
+        "$CXX" -std="$std" -O0 -w -x c++-header -I"$dir" "$dir/safe_ptr.hpp" -o "$work/pch/safe_ptr.hpp.gch"
+        seconds=$(best_of "$CXX" -std="$std" -O0 -fsyntax-only -I"$work/pch" -I"$dir" "$work/calls.cpp")
+        echo "$dir,$std,pch,$types,$arities,$seconds,$count"
+    fi
+done
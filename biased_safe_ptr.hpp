@@ -0,0 +1,543 @@
+#pragma once
+
+#include "safe_ptr.hpp"
+
+#include <atomic>
+
+namespace spl
+{
+
+template<typename T> class biased_safe_ptr;
+
+namespace detail
+{
+    struct biased_thread;
+
+    // The reference counts of an object made by make_biased_safe. The true
+    // count is biased + the count in shared. biased is only touched by the
+    // owner thread, and only while owner is set; everyone else adds to and
+    // subtracts from shared, which may go negative when references made on
+    // the owner thread are released elsewhere.
+    struct biased_block
+    {
+        // shared holds count * count_one plus these flags
+        static const long merged = 1; // biased has been folded into shared for good
+        static const long queued = 2; // waiting in the creator's queue to be merged
+        static const long count_one = 4;
+
+        std::atomic<biased_thread*> owner;
+        biased_thread* creator;
+        long biased;
+        std::atomic<long> shared;
+        biased_block* next;
+        void (*destroy)(biased_block*);
+
+        void add_ref();
+        void release();
+        void merge();
+    };
+
+    template<typename T>
+    struct biased_object : biased_block
+    {
+        template<typename... Args>
+        explicit biased_object(Args&&... args)
+            : value(std::forward<Args>(args)...)
+        {
+        }
+
+        static void destroy_object(biased_block* b)
+        {
+            delete static_cast<biased_object*>(b);
+        }
+
+        T value;
+    };
+
+    // A thread that has made biased objects. Other threads hand it the
+    // objects whose shared count went negative, for it to merge. Once the
+    // thread exits the queue is closed and they merge them themselves.
+    // Records are never freed, so their addresses identify threads for good.
+    struct biased_thread
+    {
+        std::atomic<biased_block*> queue;
+
+        biased_thread()
+            : queue(0)
+        {
+        }
+
+        static biased_block* closed()
+        {
+            return reinterpret_cast<biased_block*>(1);
+        }
+
+        // false if the thread has exited
+        bool push(biased_block* b)
+        {
+            biased_block* head = queue.load(std::memory_order_acquire);
+            do
+            {
+                if (head == closed())
+                    return false;
+                b->next = head;
+            }
+            while (!queue.compare_exchange_weak(head, b, std::memory_order_acq_rel, std::memory_order_acquire));
+            return true;
+        }
+
+        void merge_queued(biased_block* replacement)
+        {
+            biased_block* list = queue.exchange(replacement, std::memory_order_acq_rel);
+            while (list)
+            {
+                biased_block* next = list->next;
+                list->merge();
+                list = next;
+            }
+        }
+    };
+
+    // Trivially destructible, so still usable while the thread's other
+    // thread_local objects are being destroyed.
+    struct biased_thread_state
+    {
+        static biased_thread*& current()
+        {
+            static thread_local biased_thread* t = 0;
+            return t;
+        }
+
+        static bool& exiting()
+        {
+            static thread_local bool e = false;
+            return e;
+        }
+    };
+
+    // The calling thread's record, or null once the thread is exiting. From
+    // then on the thread counts like any other thread, so that others can
+    // merge its objects without racing with it.
+    inline biased_thread* local_biased_thread()
+    {
+        struct holder
+        {
+            biased_thread* thread;
+
+            holder()
+                : thread(new biased_thread)
+            {
+            }
+
+            ~holder()
+            {
+                biased_thread_state::current() = 0;
+                biased_thread_state::exiting() = true;
+                thread->merge_queued(biased_thread::closed());
+            }
+        };
+
+        biased_thread* t = biased_thread_state::current();
+        if (!t && !biased_thread_state::exiting())
+        {
+            static thread_local holder h;
+            t = biased_thread_state::current() = h.thread;
+        }
+        return t;
+    }
+
+    inline void biased_block::add_ref()
+    {
+        biased_thread* self = biased_thread_state::current();
+        if (self && owner.load(std::memory_order_relaxed) == self)
+            ++biased;
+        else
+            shared.fetch_add(count_one, std::memory_order_relaxed);
+    }
+
+    inline void biased_block::release()
+    {
+        biased_thread* self = biased_thread_state::current();
+        if (self && owner.load(std::memory_order_relaxed) == self)
+        {
+            if (--biased == 0)
+            {
+                owner.store(0, std::memory_order_relaxed);
+                if (shared.fetch_add(merged, std::memory_order_acq_rel) + merged == merged)
+                    destroy(this);
+            }
+            return;
+        }
+
+        long old = shared.load(std::memory_order_relaxed);
+        long updated;
+        do
+        {
+            updated = old - count_one;
+            if (updated < 0 && !(old & (merged | queued)))
+                updated |= queued;
+        }
+        while (!shared.compare_exchange_weak(old, updated, std::memory_order_acq_rel, std::memory_order_relaxed));
+
+        if (updated == merged)
+            destroy(this);
+        else if ((updated & queued) && !(old & queued) && !creator->push(this))
+            merge();
+    }
+
+    // Folds biased into shared and takes the object out of the queued state.
+    // Runs on the owner thread, or on another thread once the owner has
+    // exited.
+    inline void biased_block::merge()
+    {
+        long add = -queued;
+        if (owner.load(std::memory_order_relaxed))
+        {
+            add += biased * count_one + merged;
+            biased = 0;
+            owner.store(0, std::memory_order_relaxed);
+        }
+        if (shared.fetch_add(add, std::memory_order_acq_rel) + add == merged)
+            destroy(this);
+    }
+
+    struct biased_safe_ptr_access;
+}
+
+//
+// biased_safe_ptr
+//
+// A safe_ptr for objects that are copied mostly by the thread that made them
+// with make_biased_safe, using biased reference counting: that thread
+// counts its references in a plain integer, and only other threads pay for
+// atomic operations. The two counts are merged when the owner thread's count
+// drops to zero, and references made on the owner thread and released on
+// another are handed back to the owner thread to merge.
+//
+// Such an object is freed when its owner next calls make_biased_safe or
+// merge_biased_safe, or exits, rather than immediately. Objects made while
+// a thread is exiting are not biased.
+//
+// It has the interface of safe_ptr, apart from use_count(), which no thread
+// other than the owner could read. Converting to a safe_ptr allocates a
+// std::shared_ptr control block holding one reference.
+//
+// As with safe_ptr, a moved-from biased_safe_ptr may only be destroyed,
+// assigned to or swapped.
+//
+
+template<typename T>
+class biased_safe_ptr
+{
+    template <typename> friend class biased_safe_ptr;
+    friend struct detail::biased_safe_ptr_access;
+public:
+    typedef T  element_type;
+
+    biased_safe_ptr(); // will construct new T object using make_biased_safe<T>()
+
+    biased_safe_ptr(const biased_safe_ptr& other)
+        : b_(other.b_), p_(other.p_)
+    {
+        assert(b_ && "copy of moved-from biased_safe_ptr");
+        b_->add_ref();
+    }
+
+    biased_safe_ptr(biased_safe_ptr&& other) noexcept
+        : b_(other.b_), p_(other.p_)
+    {
+        other.b_ = 0;
+        other.p_ = 0;
+    }
+
+    template<typename U>
+    biased_safe_ptr(const biased_safe_ptr<U>& other, typename std::enable_if<std::is_convertible<U*, T*>::value, void*>::type = 0)
+        : b_(other.b_), p_(other.p_)
+    {
+        assert(b_ && "copy of moved-from biased_safe_ptr");
+        b_->add_ref();
+    }
+
+    template<typename U>
+    biased_safe_ptr(biased_safe_ptr<U>&& other, typename std::enable_if<std::is_convertible<U*, T*>::value, void*>::type = 0) noexcept
+        : b_(other.b_), p_(other.p_)
+    {
+        other.b_ = 0;
+        other.p_ = 0;
+    }
+
+    template<typename U>
+    biased_safe_ptr(const biased_safe_ptr<U>& other, T* p)
+        : b_(other.b_), p_(p)
+    {
+        assert(b_ && "copy of moved-from biased_safe_ptr");
+        if (!p)
+            throw std::invalid_argument("p");
+        b_->add_ref();
+    }
+
+    ~biased_safe_ptr()
+    {
+        if (b_)
+            b_->release();
+    }
+
+    biased_safe_ptr& operator=(const biased_safe_ptr& other)
+    {
+        biased_safe_ptr(other).swap(*this);
+        return *this;
+    }
+
+    biased_safe_ptr& operator=(biased_safe_ptr&& other) noexcept
+    {
+        biased_safe_ptr(std::move(other)).swap(*this);
+        return *this;
+    }
+
+    template<typename U>
+    typename std::enable_if<std::is_convertible<U*, T*>::value, biased_safe_ptr&>::type operator=(const biased_safe_ptr<U>& other)
+    {
+        biased_safe_ptr(other).swap(*this);
+        return *this;
+    }
+
+    template<typename U>
+    typename std::enable_if<std::is_convertible<U*, T*>::value, biased_safe_ptr&>::type operator=(biased_safe_ptr<U>&& other) noexcept
+    {
+        biased_safe_ptr(std::move(other)).swap(*this);
+        return *this;
+    }
+
+    T& operator*() const
+    {
+        return *get();
+    }
+
+    T* operator->() const
+    {
+        return get();
+    }
+
+    T* get() const
+    {
+        assert(p_ && "use of moved-from biased_safe_ptr");
+        return p_;
+    }
+
+    void swap(biased_safe_ptr& other) noexcept
+    {
+        std::swap(b_, other.b_);
+        std::swap(p_, other.p_);
+    }
+
+    operator safe_ptr<T>() const
+    {
+        assert(b_ && "use of moved-from biased_safe_ptr");
+        b_->add_ref();
+        // the deleter drops that reference, also if the allocation throws
+        detail::biased_block* b = b_;
+        return detail::safe_ptr_access::adopt(std::shared_ptr<T>(p_, [b](T*) { b->release(); }));
+    }
+
+private:
+    biased_safe_ptr(detail::biased_block* b, T* p) noexcept
+        : b_(b), p_(p)
+    {
+    }
+
+    detail::biased_block* b_;
+    T* p_;
+};
+
+namespace detail
+{
+    struct biased_safe_ptr_access
+    {
+        template<typename T, typename U>
+        static biased_safe_ptr<T> alias(const biased_safe_ptr<U>& own, T* p)
+        {
+            own.b_->add_ref();
+            return biased_safe_ptr<T>(own.b_, p);
+        }
+
+        template<typename T, typename U>
+        static biased_safe_ptr<T> alias(biased_safe_ptr<U>&& own, T* p)
+        {
+            biased_block* b = own.b_;
+            own.b_ = 0;
+            own.p_ = 0;
+            return biased_safe_ptr<T>(b, p);
+        }
+
+        template<typename T>
+        static biased_safe_ptr<T> adopt(biased_object<T>* b)
+        {
+            return biased_safe_ptr<T>(b, &b->value);
+        }
+    };
+}
+
+template<class T, class U>
+bool operator==(const biased_safe_ptr<T>& a, const biased_safe_ptr<U>& b)
+{
+    return a.get() == b.get();
+}
+
+template<class T, class U>
+bool operator!=(const biased_safe_ptr<T>& a, const biased_safe_ptr<U>& b)
+{
+    return a.get() != b.get();
+}
+
+template<class T, class U>
+bool operator<(const biased_safe_ptr<T>& a, const biased_safe_ptr<U>& b)
+{
+    return a.get() < b.get();
+}
+
+template<class T, class U>
+bool operator>(const biased_safe_ptr<T>& a, const biased_safe_ptr<U>& b)
+{
+    return a.get() > b.get();
+}
+
+template<class T, class U>
+bool operator>=(const biased_safe_ptr<T>& a, const biased_safe_ptr<U>& b)
+{
+    return a.get() >= b.get();
+}
+
+template<class T, class U>
+bool operator<=(const biased_safe_ptr<T>& a, const biased_safe_ptr<U>& b)
+{
+    return a.get() <= b.get();
+}
+
+template<class E, class T, class U>
+std::basic_ostream<E, T>& operator<<(std::basic_ostream<E, T>& out, const biased_safe_ptr<U>& p)
+{
+    return out << p.get();
+}
+
+template<class T>
+void swap(biased_safe_ptr<T>& a, biased_safe_ptr<T>& b) noexcept
+{
+    a.swap(b);
+}
+
+template<class T>
+T* get_pointer(biased_safe_ptr<T> const& p)
+{
+    return p.get();
+}
+
+//
+// pointer casts
+//
+// As for safe_ptr. The && overloads never touch a reference count.
+//
+
+template <class T, class U>
+biased_safe_ptr<T> static_pointer_cast(const biased_safe_ptr<U>& p)
+{
+    return detail::biased_safe_ptr_access::alias(p, static_cast<T*>(p.get()));
+}
+
+template <class T, class U>
+biased_safe_ptr<T> static_pointer_cast(biased_safe_ptr<U>&& p)
+{
+    T* t = static_cast<T*>(p.get());
+    return detail::biased_safe_ptr_access::alias(std::move(p), t);
+}
+
+template <class T, class U>
+biased_safe_ptr<T> const_pointer_cast(const biased_safe_ptr<U>& p)
+{
+    return detail::biased_safe_ptr_access::alias(p, const_cast<T*>(p.get()));
+}
+
+template <class T, class U>
+biased_safe_ptr<T> const_pointer_cast(biased_safe_ptr<U>&& p)
+{
+    T* t = const_cast<T*>(p.get());
+    return detail::biased_safe_ptr_access::alias(std::move(p), t);
+}
+
+template <class T, class U>
+biased_safe_ptr<T> dynamic_pointer_cast(const biased_safe_ptr<U>& p)
+{
+    T* t = dynamic_cast<T*>(p.get());
+    if(!t)
+        throw std::bad_cast();
+    return detail::biased_safe_ptr_access::alias(p, t);
+}
+
+template <class T, class U>
+biased_safe_ptr<T> dynamic_pointer_cast(biased_safe_ptr<U>&& p)
+{
+    T* t = dynamic_cast<T*>(p.get());
+    if(!t)
+        throw std::bad_cast();
+    return detail::biased_safe_ptr_access::alias(std::move(p), t);
+}
+
+//
+// merge_biased_safe
+//
+// Merges the objects made on the calling thread whose last reference was
+// released on another thread, freeing them. make_biased_safe does this as
+// well; call it on threads that hand out biased objects without making new
+// ones for a long time.
+//
+
+inline void merge_biased_safe()
+{
+    detail::biased_thread* self = detail::biased_thread_state::current();
+    if (self && self->queue.load(std::memory_order_relaxed))
+        self->merge_queued(0);
+}
+
+//
+// make_biased_safe
+//
+// make_safe for biased_safe_ptr; the calling thread becomes the object's
+// owner. The counts and the object are one allocation.
+//
+
+template<typename T, typename... Args>
+biased_safe_ptr<T> make_biased_safe(Args&&... args)
+{
+    merge_biased_safe();
+    detail::biased_object<T>* b = new detail::biased_object<T>(std::forward<Args>(args)...);
+    detail::biased_thread* self = detail::local_biased_thread();
+    b->owner.store(self, std::memory_order_relaxed);
+    b->creator = self;
+    b->biased = self ? 1 : 0;
+    b->shared.store(self ? 0 : detail::biased_block::count_one | detail::biased_block::merged, std::memory_order_relaxed);
+    b->next = 0;
+    b->destroy = &detail::biased_object<T>::destroy_object;
+    return detail::biased_safe_ptr_access::adopt(b);
+}
+
+template<typename T>
+biased_safe_ptr<T>::biased_safe_ptr()
+    : b_(0), p_(0)
+{
+    make_biased_safe<T>().swap(*this);
+}
+
+} // namespace
+
+namespace std
+{
+
+template<typename T>
+struct hash<spl::biased_safe_ptr<T> >
+{
+    std::size_t operator()(const spl::biased_safe_ptr<T>& p) const noexcept
+    {
+        return spl::detail::hash_address(p.get());
+    }
+};
+
+} // namespace
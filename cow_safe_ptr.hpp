@@ -0,0 +1,226 @@
+#pragma once
+
+#include "safe_ptr.hpp"
+
+#include <atomic>
+
+// ThreadSanitizer cannot model standalone fences (GCC warns about them under
+// -fsanitize=thread), so sanitizer builds order through the reference count.
+#if defined(__SANITIZE_THREAD__)
+#define SPL_THREAD_SANITIZER 1
+#elif defined(__has_feature)
+#if __has_feature(thread_sanitizer)
+#define SPL_THREAD_SANITIZER 1
+#endif
+#endif
+
+namespace spl
+{
+
+template<typename T> class cow_safe_ptr;
+
+//
+// cow_write_guard
+//
+// Mutable access to the object of a cow_safe_ptr for a batch of changes.
+// The object is cloned at most once, when the guard is made, and the guard
+// then hands out T& without checking again. The cow_safe_ptr must not be
+// copied while a guard is alive, since the copy would see the changes;
+// the cow_safe_ptr counts its guards and asserts this.
+//
+
+template<typename T>
+class cow_write_guard
+{
+public:
+    explicit cow_write_guard(cow_safe_ptr<T>& owner)
+        : owner_(&owner), object_(&owner.write())
+    {
+        ++owner_->writers_;
+    }
+
+    cow_write_guard(cow_write_guard&& other) noexcept
+        : owner_(other.owner_), object_(other.object_)
+    {
+        other.owner_ = 0;
+    }
+
+    ~cow_write_guard()
+    {
+        if (owner_)
+            --owner_->writers_;
+    }
+
+    T& operator*() const
+    {
+        return *object_;
+    }
+
+    T* operator->() const
+    {
+        return object_;
+    }
+
+private:
+    cow_write_guard(const cow_write_guard&);
+    cow_write_guard& operator=(const cow_write_guard&);
+
+    cow_safe_ptr<T>* owner_;
+    T* object_;
+};
+
+//
+// cow_safe_ptr
+//
+// A copy-on-write value: copies share one T, and the first mutable access
+// through a cow_safe_ptr whose T is shared replaces it with a private clone,
+// made with make_safe<T>(const T&) so that T::make_safe hooks apply. Const
+// access never copies.
+//
+// The object's dynamic type must be exactly T, or the clone would slice it.
+// A cow_safe_ptr<T> cannot be made from a safe_ptr<Derived>, and a
+// polymorphic T must provide a T::make_safe(const T&) hook that clones the
+// dynamic type, e.g. through a virtual clone().
+//
+// As with safe_ptr, different cow_safe_ptrs sharing a T may be used from
+// different threads, but one cow_safe_ptr must not be written on one thread
+// while used on another. The object must not give out owners of itself
+// behind the cow_safe_ptr's back, e.g. through safe_from_this() or weak
+// pointers, or writes will be visible to them.
+//
+
+template<typename T>
+class cow_safe_ptr
+{
+    friend class cow_write_guard<T>;
+public:
+    typedef T  element_type;
+
+    cow_safe_ptr() // constructs T with make_safe<T>()
+        : writers_(0)
+    {
+    }
+
+    explicit cow_safe_ptr(safe_ptr<T> p) noexcept
+        : p_(std::move(p))
+        , writers_(0)
+    {
+    }
+
+    // write() would clone only the U part of the object
+    template<typename U>
+    explicit cow_safe_ptr(safe_ptr<U> p) = delete;
+
+    cow_safe_ptr(const cow_safe_ptr& other)
+        : p_(other.p_)
+        , writers_(0)
+    {
+        assert(other.writers_ == 0 && "copy of cow_safe_ptr with an open cow_write_guard");
+    }
+
+    cow_safe_ptr(cow_safe_ptr&& other) noexcept
+        : p_(std::move(other.p_))
+        , writers_(0)
+    {
+        assert(other.writers_ == 0 && "move of cow_safe_ptr with an open cow_write_guard");
+    }
+
+    cow_safe_ptr& operator=(const cow_safe_ptr& other)
+    {
+        assert(writers_ == 0 && other.writers_ == 0 && "assignment of cow_safe_ptr with an open cow_write_guard");
+        p_ = other.p_;
+        return *this;
+    }
+
+    cow_safe_ptr& operator=(cow_safe_ptr&& other) noexcept
+    {
+        assert(writers_ == 0 && other.writers_ == 0 && "assignment of cow_safe_ptr with an open cow_write_guard");
+        p_ = std::move(other.p_);
+        return *this;
+    }
+
+    const T& operator*() const
+    {
+        return *p_;
+    }
+
+    const T* operator->() const
+    {
+        return p_.get();
+    }
+
+    const T* get() const
+    {
+        return p_.get();
+    }
+
+    // Shares the current value; a later write through this cow_safe_ptr
+    // clones it and leaves the returned safe_ptr unchanged.
+    operator safe_ptr<const T>() const
+    {
+        return p_;
+    }
+
+    // The object, cloned first if it is shared.
+    T& write()
+    {
+        static_assert(!std::is_polymorphic<T>::value || detail::has_make_safe<T, const T&>::value,
+                      "a polymorphic T needs a T::make_safe(const T&) hook to clone its dynamic type");
+        if (p_.use_count() != 1)
+            p_ = make_safe<T>(static_cast<const T&>(*p_));
+        else
+        {
+            // see the last reads by former sharers
+        #ifdef SPL_THREAD_SANITIZER
+            safe_ptr<T> sharer(p_); // dropping a reference is an acquire on the count
+        #else
+            std::atomic_thread_fence(std::memory_order_acquire);
+        #endif
+        }
+        return *p_;
+    }
+
+    cow_write_guard<T> edit()
+    {
+        return cow_write_guard<T>(*this);
+    }
+
+    bool unique() const
+    {
+        return p_.unique();
+    }
+
+    long use_count() const
+    {
+        return p_.use_count();
+    }
+
+    void swap(cow_safe_ptr& other) noexcept
+    {
+        p_.swap(other.p_);
+    }
+
+private:
+    safe_ptr<T> p_;
+    int writers_; // open cow_write_guards; kept in every build so the layout does not depend on NDEBUG
+};
+
+template<class T>
+void swap(cow_safe_ptr<T>& a, cow_safe_ptr<T>& b) noexcept
+{
+    a.swap(b);
+}
+
+//
+// make_cow_safe
+//
+// cow_safe_ptr equivalent to make_safe
+//
+
+template<typename T, typename... Args>
+cow_safe_ptr<T> make_cow_safe(Args&&... args)
+{
+    return cow_safe_ptr<T>(make_safe<T>(std::forward<Args>(args)...));
+}
+
+} // namespace
@@ -0,0 +1,182 @@
+#pragma once
+
+#include "safe_ptr.hpp"
+
+#include <vector>
+
+namespace spl
+{
+
+//
+// fast_cast_info
+//
+// Identifies a class registered for fast casting. display holds the class's
+// registered ancestors from the root down to the class itself, so display
+// has depth + 1 entries and display[depth] is this info.
+//
+
+struct fast_cast_info
+{
+    std::size_t depth;
+    const fast_cast_info* const* display;
+};
+
+namespace detail
+{
+    // Owns a fast_cast_info and its display. Built once per class, the first
+    // time the class's fast_cast_class() is called.
+    class fast_cast_node
+    {
+    public:
+        fast_cast_node()
+            : display_(1, &info)
+        {
+            info.depth = 0;
+            info.display = &display_[0];
+        }
+
+        explicit fast_cast_node(const fast_cast_info& parent)
+            : display_(parent.display, parent.display + parent.depth + 1)
+        {
+            display_.push_back(&info);
+            info.depth = parent.depth + 1;
+            info.display = &display_[0];
+        }
+
+        fast_cast_info info;
+
+    private:
+        fast_cast_node(const fast_cast_node&);
+        fast_cast_node& operator=(const fast_cast_node&);
+
+        std::vector<const fast_cast_info*> display_;
+    };
+}
+
+//
+// fast_castable, SPL_FAST_CAST
+//
+// Opt-in replacement for dynamic_cast on hot dispatch paths. The root of a
+// hierarchy derives from fast_castable, and every class in it that casts
+// should target names its parent with SPL_FAST_CAST(Class, Parent) in a
+// public section:
+//
+//   struct message : spl::fast_castable { SPL_FAST_CAST(message, spl::fast_castable) ... };
+//   struct order : message { SPL_FAST_CAST(order, message) ... };
+//   struct limit_order : order { SPL_FAST_CAST(limit_order, order) ... };
+//
+// A cast is then one virtual call and one comparison at a fixed index of the
+// object's ancestor display, whatever the depth or width of the hierarchy,
+// and never compares type_info names. Registered classes must form a single
+// inheritance chain of non-virtual bases. Objects of an unregistered class
+// are seen as its nearest registered ancestor, and casting to an
+// unregistered class does not compile.
+//
+
+class fast_castable
+{
+public:
+    typedef fast_castable spl_fast_cast_self;
+
+    virtual ~fast_castable() {}
+
+    static const fast_cast_info& fast_cast_class()
+    {
+        static const detail::fast_cast_node node;
+        return node.info;
+    }
+
+    virtual const fast_cast_info& fast_cast_dynamic_class() const
+    {
+        return fast_cast_class();
+    }
+};
+
+#define SPL_FAST_CAST(Class, Parent) \
+    typedef Class spl_fast_cast_self; \
+    static const ::spl::fast_cast_info& fast_cast_class() \
+    { \
+        static_assert(std::is_base_of<Parent, Class>::value, "SPL_FAST_CAST: Parent must be a base of Class"); \
+        static const ::spl::detail::fast_cast_node node(Parent::fast_cast_class()); \
+        return node.info; \
+    } \
+    const ::spl::fast_cast_info& fast_cast_dynamic_class() const override \
+    { \
+        return Class::fast_cast_class(); \
+    }
+
+// True for fast_castable and the classes registered with SPL_FAST_CAST,
+// which are the only valid targets of fast_dynamic_cast.
+template<class T>
+struct is_fast_cast_registered
+    : std::is_same<typename std::remove_cv<T>::type::spl_fast_cast_self, typename std::remove_cv<T>::type>
+{
+};
+
+//
+// fast_dynamic_cast
+//
+// dynamic_cast<T*>(p) for registered classes: p converted to T*, or null if
+// *p is not a T.
+//
+
+template<class T, class U>
+T* fast_dynamic_cast(U* p)
+{
+    typedef typename std::remove_cv<T>::type target_type;
+    static_assert(is_fast_cast_registered<T>::value, "fast_dynamic_cast: the target class is not registered with SPL_FAST_CAST");
+    const fast_cast_info& target = target_type::fast_cast_class();
+    const fast_cast_info& actual = p->fast_cast_dynamic_class();
+    if (actual.depth < target.depth || actual.display[target.depth] != &target)
+        return 0;
+    return static_cast<T*>(p);
+}
+
+//
+// fast_dynamic_pointer_cast, try_fast_dynamic_pointer_cast
+//
+// dynamic_pointer_cast and try_dynamic_pointer_cast for registered classes,
+// with the same results, ownership transfer and exceptions.
+//
+
+template <class T, class U>
+safe_ptr<T> fast_dynamic_pointer_cast(const safe_ptr<U>& p)
+{
+    SPL_INSTRUMENT_COUNT(T, casts);
+    T* t = fast_dynamic_cast<T>(p.get());
+    if(!t)
+        throw std::bad_cast();
+    return detail::safe_ptr_access::alias(p, t);
+}
+
+template <class T, class U>
+safe_ptr<T> fast_dynamic_pointer_cast(safe_ptr<U>&& p)
+{
+    SPL_INSTRUMENT_COUNT(T, casts);
+    T* t = fast_dynamic_cast<T>(p.get());
+    if(!t)
+        throw std::bad_cast();
+    return detail::safe_ptr_access::alias(std::move(p), t);
+}
+
+template <class T, class U>
+maybe_safe_ptr<T> try_fast_dynamic_pointer_cast(const safe_ptr<U>& p)
+{
+    SPL_INSTRUMENT_COUNT(T, casts);
+    T* t = fast_dynamic_cast<T>(p.get());
+    if(!t)
+        return maybe_safe_ptr<T>();
+    return detail::safe_ptr_access::alias(p, t);
+}
+
+template <class T, class U>
+maybe_safe_ptr<T> try_fast_dynamic_pointer_cast(safe_ptr<U>&& p)
+{
+    SPL_INSTRUMENT_COUNT(T, casts);
+    T* t = fast_dynamic_cast<T>(p.get());
+    if(!t)
+        return maybe_safe_ptr<T>();
+    return detail::safe_ptr_access::alias(std::move(p), t);
+}
+
+} // namespace
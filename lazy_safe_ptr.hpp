@@ -0,0 +1,194 @@
+#pragma once
+
+#include "safe_ptr.hpp"
+
+#include <atomic>
+#include <thread>
+
+namespace spl
+{
+
+//
+// lazy_safe_ptr
+//
+// A safe_ptr whose object is made with make_safe<T>() on first use rather
+// than on construction, for members and container slots that are often
+// assigned or never used before they go away. Constructing, moving and
+// destroying an unused lazy_safe_ptr allocate nothing.
+//
+// Any number of threads may use a shared lazy_safe_ptr at once; they all get
+// the same object. Exactly one of them runs make_safe<T>() while the others
+// wait for it; if it throws, the next use tries again. Once created, access
+// is one acquire load. The safe_ptr is kept in place, so the object's own
+// allocation is the only one.
+//
+// Copies of a lazy_safe_ptr whose object exists share it; copies of one
+// whose object does not yet exist each create their own. Assignment, like
+// that of safe_ptr, is not safe to run concurrently with other uses.
+//
+
+template<typename T>
+class lazy_safe_ptr
+{
+public:
+    typedef T  element_type;
+
+    lazy_safe_ptr() noexcept
+        : state_(empty)
+    {
+    }
+
+    explicit lazy_safe_ptr(safe_ptr<T> p) noexcept
+        : state_(ready)
+    {
+        ::new (static_cast<void*>(storage_)) safe_ptr<T>(std::move(p));
+    }
+
+    lazy_safe_ptr(const lazy_safe_ptr& other)
+        : state_(empty)
+    {
+        if (other.state_.load(std::memory_order_acquire) == ready)
+        {
+            ::new (static_cast<void*>(storage_)) safe_ptr<T>(other.slot());
+            state_.store(ready, std::memory_order_relaxed);
+        }
+    }
+
+    lazy_safe_ptr(lazy_safe_ptr&& other) noexcept
+        : state_(empty)
+    {
+        take(other);
+    }
+
+    ~lazy_safe_ptr()
+    {
+        reset();
+    }
+
+    lazy_safe_ptr& operator=(const lazy_safe_ptr& other)
+    {
+        lazy_safe_ptr(other).swap(*this);
+        return *this;
+    }
+
+    lazy_safe_ptr& operator=(lazy_safe_ptr&& other) noexcept
+    {
+        if (this != &other)
+        {
+            reset();
+            take(other);
+        }
+        return *this;
+    }
+
+    lazy_safe_ptr& operator=(safe_ptr<T> p) noexcept
+    {
+        reset();
+        ::new (static_cast<void*>(storage_)) safe_ptr<T>(std::move(p));
+        state_.store(ready, std::memory_order_relaxed);
+        return *this;
+    }
+
+    T& operator*() const
+    {
+        return *get();
+    }
+
+    T* operator->() const
+    {
+        return get();
+    }
+
+    // Creates the object if it does not exist yet.
+    T* get() const
+    {
+        return materialize().get();
+    }
+
+    // Creates the object if it does not exist yet.
+    operator safe_ptr<T>() const
+    {
+        return materialize();
+    }
+
+    // True once the object exists; never creates it.
+    bool materialized() const noexcept
+    {
+        return state_.load(std::memory_order_acquire) == ready;
+    }
+
+    void swap(lazy_safe_ptr& other) noexcept
+    {
+        lazy_safe_ptr tmp(std::move(other));
+        other = std::move(*this);
+        *this = std::move(tmp);
+    }
+
+private:
+    enum { empty, constructing, ready };
+
+    safe_ptr<T>& slot() const
+    {
+        return *reinterpret_cast<safe_ptr<T>*>(storage_);
+    }
+
+    void reset() noexcept
+    {
+        if (state_.load(std::memory_order_relaxed) == ready)
+        {
+            slot().~safe_ptr<T>();
+            state_.store(empty, std::memory_order_relaxed);
+        }
+    }
+
+    // Moves other's safe_ptr, if any, into this empty lazy_safe_ptr.
+    void take(lazy_safe_ptr& other) noexcept
+    {
+        if (other.state_.load(std::memory_order_acquire) == ready)
+        {
+            ::new (static_cast<void*>(storage_)) safe_ptr<T>(std::move(other.slot()));
+            other.reset();
+            state_.store(ready, std::memory_order_relaxed);
+        }
+    }
+
+    const safe_ptr<T>& materialize() const
+    {
+        int state = state_.load(std::memory_order_acquire);
+        while (state != ready)
+        {
+            state = empty;
+            if (state_.compare_exchange_weak(state, constructing, std::memory_order_acquire, std::memory_order_acquire))
+            {
+                try
+                {
+                    ::new (static_cast<void*>(storage_)) safe_ptr<T>(make_safe<T>());
+                }
+                catch (...)
+                {
+                    state_.store(empty, std::memory_order_release);
+                    throw;
+                }
+                state_.store(ready, std::memory_order_release);
+                break;
+            }
+            if (state == constructing)
+            {
+                std::this_thread::yield();
+                state = state_.load(std::memory_order_acquire);
+            }
+        }
+        return slot();
+    }
+
+    mutable std::atomic<int> state_;
+    alignas(safe_ptr<T>) mutable unsigned char storage_[sizeof(safe_ptr<T>)];
+};
+
+template<class T>
+void swap(lazy_safe_ptr<T>& a, lazy_safe_ptr<T>& b) noexcept
+{
+    a.swap(b);
+}
+
+} // namespace
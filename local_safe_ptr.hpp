@@ -0,0 +1,398 @@
+#pragma once
+
+#include "safe_ptr.hpp"
+
+#include <thread>
+
+namespace spl
+{
+
+template<typename T> class local_safe_ptr;
+
+namespace detail
+{
+    //
+    // Reference count shared by the local_safe_ptrs to one object. The count
+    // is a plain integer, so every local_safe_ptr to an object must be
+    // copied and destroyed on the thread that created the first one; debug
+    // builds assert this. self keeps the block, and through it the object,
+    // alive while the count is non-zero; safe_ptrs converted from a
+    // local_safe_ptr alias it and so keep them alive after that.
+    //
+    struct local_block
+    {
+        std::size_t count;
+        std::thread::id thread;
+        std::shared_ptr<void> self;
+
+        local_block()
+            : count(1), thread(std::this_thread::get_id())
+        {
+        }
+
+        void add_ref()
+        {
+            assert(thread == std::this_thread::get_id() && "local_safe_ptr copied on another thread");
+            ++count;
+        }
+
+        void release()
+        {
+            assert(thread == std::this_thread::get_id() && "local_safe_ptr released on another thread");
+            if (--count == 0)
+            {
+                std::shared_ptr<void> last(std::move(self)); // may destroy *this
+            }
+        }
+    };
+
+    // object built in the same allocation as its block
+    template<typename T>
+    struct local_inline_block : local_block
+    {
+        T value;
+
+        template<typename... Args>
+        explicit local_inline_block(Args&&... args)
+            : value(std::forward<Args>(args)...)
+        {
+        }
+    };
+
+    // object owned by a safe_ptr, e.g. one made by T::make_safe
+    struct local_owner_block : local_block
+    {
+        std::shared_ptr<void> object;
+
+        explicit local_owner_block(std::shared_ptr<void>&& o)
+            : object(std::move(o))
+        {
+        }
+    };
+
+    // True for T derived from std::enable_shared_from_this, which is only
+    // wired up when the object is made as the T of a shared_ptr.
+    template<typename U>
+    std::true_type shares_from_this(const volatile std::enable_shared_from_this<U>*);
+    std::false_type shares_from_this(...);
+
+    template<typename T, typename... Args>
+    struct make_local_owned
+        : std::integral_constant<bool, has_make_safe<T, Args...>::value ||
+                                       decltype(shares_from_this(static_cast<T*>(0)))::value>
+    {
+    };
+
+    struct local_safe_ptr_access
+    {
+        template<typename T, typename U>
+        static local_safe_ptr<T> alias(const local_safe_ptr<U>& own, T* p)
+        {
+            own.b_->add_ref();
+            return local_safe_ptr<T>(own.b_, p);
+        }
+
+        template<typename T, typename U>
+        static local_safe_ptr<T> alias(local_safe_ptr<U>&& own, T* p)
+        {
+            local_safe_ptr<T> result(own.b_, p);
+            own.b_ = 0;
+            own.p_ = 0;
+            return result;
+        }
+
+        template<typename T, typename... Args>
+        static local_safe_ptr<T> make_inline(Args&&... args)
+        {
+            std::shared_ptr<local_inline_block<T> > b = std::make_shared<local_inline_block<T> >(std::forward<Args>(args)...);
+            local_inline_block<T>* raw = b.get();
+            raw->self = std::move(b);
+            return local_safe_ptr<T>(raw, &raw->value);
+        }
+
+        // T::make_safe exists, or T derives from enable_safe_from_this
+        template<typename T, typename... Args>
+        static local_safe_ptr<T> make_local(std::true_type, Args&&... args)
+        {
+            return make_owned(::spl::make_safe<T>(std::forward<Args>(args)...));
+        }
+
+        template<typename T, typename... Args>
+        static local_safe_ptr<T> make_local(std::false_type, Args&&... args)
+        {
+            return make_inline<T>(std::forward<Args>(args)...);
+        }
+
+        template<typename T>
+        static local_safe_ptr<T> make_owned(safe_ptr<T>&& p)
+        {
+            T* t = p.get();
+            std::shared_ptr<local_owner_block> b = std::make_shared<local_owner_block>(std::move(p).into_shared());
+            local_owner_block* raw = b.get();
+            raw->self = std::move(b);
+            return local_safe_ptr<T>(raw, t);
+        }
+    };
+
+} // namespace detail
+
+//
+// local_safe_ptr
+//
+// A non-null pointer with a non-atomic reference count, for objects that are
+// created, shared and dropped within a single thread. Copies cost a plain
+// increment. Turning one into a thread-safe safe_ptr is explicit, and the
+// resulting safe_ptr may then leave the thread; the object lives until both
+// the local_safe_ptrs and the safe_ptrs are gone.
+//
+// As with safe_ptr, a moved-from local_safe_ptr holds null and may only be
+// destroyed, assigned to or swapped.
+//
+
+template<typename T>
+class local_safe_ptr
+{
+    template <typename> friend class local_safe_ptr;
+    friend struct detail::local_safe_ptr_access;
+public:
+    typedef T  element_type;
+
+    local_safe_ptr(const local_safe_ptr& other)
+        : b_(other.b_), p_(other.get())
+    {
+        b_->add_ref();
+    }
+
+    local_safe_ptr(local_safe_ptr&& other) noexcept
+        : b_(other.b_), p_(other.p_)
+    {
+        other.b_ = 0;
+        other.p_ = 0;
+    }
+
+    template<typename U>
+    local_safe_ptr(const local_safe_ptr<U>& other, typename std::enable_if<std::is_convertible<U*, T*>::value, void*>::type = 0)
+        : b_(other.b_), p_(other.get())
+    {
+        b_->add_ref();
+    }
+
+    template<typename U>
+    local_safe_ptr(local_safe_ptr<U>&& other, typename std::enable_if<std::is_convertible<U*, T*>::value, void*>::type = 0) noexcept
+        : b_(other.b_), p_(other.p_)
+    {
+        other.b_ = 0;
+        other.p_ = 0;
+    }
+
+    // Costs one allocation for the local count.
+    template<typename U>
+    explicit local_safe_ptr(safe_ptr<U> p, typename std::enable_if<std::is_convertible<U*, T*>::value, void*>::type = 0)
+        : b_(0), p_(0)
+    {
+        detail::local_safe_ptr_access::make_owned(safe_ptr<T>(std::move(p))).swap(*this);
+    }
+
+    ~local_safe_ptr()
+    {
+        if (b_)
+            b_->release();
+    }
+
+    local_safe_ptr& operator=(const local_safe_ptr& other)
+    {
+        local_safe_ptr(other).swap(*this);
+        return *this;
+    }
+
+    local_safe_ptr& operator=(local_safe_ptr&& other) noexcept
+    {
+        local_safe_ptr(std::move(other)).swap(*this);
+        return *this;
+    }
+
+    template<typename U>
+    typename std::enable_if<std::is_convertible<U*, T*>::value, local_safe_ptr&>::type
+    operator=(const local_safe_ptr<U>& other)
+    {
+        local_safe_ptr(other).swap(*this);
+        return *this;
+    }
+
+    template<typename U>
+    typename std::enable_if<std::is_convertible<U*, T*>::value, local_safe_ptr&>::type
+    operator=(local_safe_ptr<U>&& other) noexcept
+    {
+        local_safe_ptr(std::move(other)).swap(*this);
+        return *this;
+    }
+
+    T& operator*() const
+    {
+        return *get();
+    }
+
+    T* operator->() const
+    {
+        return get();
+    }
+
+    T* get() const
+    {
+        assert(p_ && "use of moved-from local_safe_ptr");
+        return p_;
+    }
+
+    // The number of local_safe_ptrs to the object. safe_ptrs converted from
+    // them are not counted, so the object may be shared even when this is 1.
+    long use_count() const
+    {
+        get();
+        return static_cast<long>(b_->count);
+    }
+
+    void swap(local_safe_ptr& other) noexcept
+    {
+        std::swap(b_, other.b_);
+        std::swap(p_, other.p_);
+    }
+
+    // Shares ownership with a thread-safe safe_ptr; one atomic increment.
+    template<typename D, typename = typename
+        std::enable_if<std::is_convertible<T*, D*>::value>::type>
+    explicit operator safe_ptr<D>() const
+    {
+        return detail::safe_ptr_access::adopt(std::shared_ptr<D>(b_->self, get()));
+    }
+
+private:
+    local_safe_ptr(detail::local_block* b, T* p) noexcept
+        : b_(b), p_(p)
+    {
+    }
+
+    detail::local_block* b_;
+    T* p_;
+};
+
+template<class T, class U>
+bool operator==(const local_safe_ptr<T>& a, const local_safe_ptr<U>& b)
+{
+    return a.get() == b.get();
+}
+
+template<class T, class U>
+bool operator!=(const local_safe_ptr<T>& a, const local_safe_ptr<U>& b)
+{
+    return a.get() != b.get();
+}
+
+template<class T, class U>
+bool operator<(const local_safe_ptr<T>& a, const local_safe_ptr<U>& b)
+{
+    return a.get() < b.get();
+}
+
+template<class T, class U>
+bool operator>(const local_safe_ptr<T>& a, const local_safe_ptr<U>& b)
+{
+    return a.get() > b.get();
+}
+
+template<class T, class U>
+bool operator>=(const local_safe_ptr<T>& a, const local_safe_ptr<U>& b)
+{
+    return a.get() >= b.get();
+}
+
+template<class T, class U>
+bool operator<=(const local_safe_ptr<T>& a, const local_safe_ptr<U>& b)
+{
+    return a.get() <= b.get();
+}
+
+template<class E, class T, class U>
+std::basic_ostream<E, T>& operator<<(std::basic_ostream<E, T>& out, const local_safe_ptr<U>& p)
+{
+    return out << p.get();
+}
+
+template<class T>
+void swap(local_safe_ptr<T>& a, local_safe_ptr<T>& b) noexcept
+{
+    a.swap(b);
+}
+
+template<class T>
+T* get_pointer(local_safe_ptr<T> const& p)
+{
+    return p.get();
+}
+
+template <class T, class U>
+local_safe_ptr<T> static_pointer_cast(const local_safe_ptr<U>& p)
+{
+    return detail::local_safe_ptr_access::alias(p, static_cast<T*>(p.get()));
+}
+
+template <class T, class U>
+local_safe_ptr<T> static_pointer_cast(local_safe_ptr<U>&& p)
+{
+    T* t = static_cast<T*>(p.get());
+    return detail::local_safe_ptr_access::alias(std::move(p), t);
+}
+
+template <class T, class U>
+local_safe_ptr<T> const_pointer_cast(const local_safe_ptr<U>& p)
+{
+    return detail::local_safe_ptr_access::alias(p, const_cast<T*>(p.get()));
+}
+
+template <class T, class U>
+local_safe_ptr<T> const_pointer_cast(local_safe_ptr<U>&& p)
+{
+    T* t = const_cast<T*>(p.get());
+    return detail::local_safe_ptr_access::alias(std::move(p), t);
+}
+
+template <class T, class U>
+local_safe_ptr<T> dynamic_pointer_cast(const local_safe_ptr<U>& p)
+{
+    T* t = dynamic_cast<T*>(p.get());
+    if(!t)
+        throw std::bad_cast();
+    return detail::local_safe_ptr_access::alias(p, t);
+}
+
+template <class T, class U>
+local_safe_ptr<T> dynamic_pointer_cast(local_safe_ptr<U>&& p)
+{
+    T* t = dynamic_cast<T*>(p.get());
+    if(!t)
+        throw std::bad_cast();
+    return detail::local_safe_ptr_access::alias(std::move(p), t);
+}
+
+//
+// make_local_safe
+//
+// local_safe_ptr equivalent to make_safe. The object and its count share one
+// allocation, unless T::make_safe exists or T derives from
+// enable_safe_from_this. Then make_safe builds the object, so that
+// safe_from_this() works, and the count is allocated separately.
+//
+
+template<typename T, typename... Args>
+local_safe_ptr<T> make_local_safe(Args&&... args)
+{
+#ifdef __cpp_if_constexpr
+    if constexpr (detail::make_local_owned<T, Args...>::value)
+        return detail::local_safe_ptr_access::make_owned(make_safe<T>(std::forward<Args>(args)...));
+    else
+        return detail::local_safe_ptr_access::make_inline<T>(std::forward<Args>(args)...);
+#else
+    return detail::local_safe_ptr_access::make_local<T>(detail::make_local_owned<T, Args...>(), std::forward<Args>(args)...);
+#endif
+}
+
+} // namespace
@@ -0,0 +1,138 @@
+#pragma once
+
+#include "safe_ptr.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <new>
+
+// Size of the unit the CPU keeps coherent between cores. 64 bytes on
+// current x86 and most ARM cores; define it to 128 for CPUs that fetch
+// pairs of lines, such as Apple's.
+#ifndef SPL_CACHE_LINE_SIZE
+#define SPL_CACHE_LINE_SIZE 64
+#endif
+
+namespace spl
+{
+
+namespace detail
+{
+    // ::operator new does not honour alignments above the fundamental one
+    // before C++17, so the block is over-allocated and the original address
+    // kept just below the aligned one.
+    inline void* allocate_aligned(std::size_t size, std::size_t alignment)
+    {
+        if (size > std::numeric_limits<std::size_t>::max() - alignment - sizeof(void*))
+            throw std::bad_array_new_length();
+        void* raw = ::operator new(size + alignment + sizeof(void*));
+        std::uintptr_t aligned = (reinterpret_cast<std::uintptr_t>(raw) + sizeof(void*) + alignment - 1) & ~std::uintptr_t(alignment - 1);
+        reinterpret_cast<void**>(aligned)[-1] = raw;
+        return reinterpret_cast<void*>(aligned);
+    }
+
+    inline void deallocate_aligned(void* p) noexcept
+    {
+        ::operator delete(static_cast<void**>(p)[-1]);
+    }
+}
+
+//
+// cache_aligned_allocator
+//
+// Allocates whole cache lines: every block starts on a line boundary and is
+// padded to a whole number of lines, so nothing else is ever placed on the
+// lines it uses. Types aligned more strictly than a cache line get their
+// own alignment.
+//
+
+template<typename T>
+class cache_aligned_allocator
+{
+public:
+    typedef T value_type;
+
+    static const std::size_t alignment = alignof(T) > SPL_CACHE_LINE_SIZE ? alignof(T) : SPL_CACHE_LINE_SIZE;
+
+    cache_aligned_allocator() noexcept
+    {
+    }
+
+    template<typename U>
+    cache_aligned_allocator(const cache_aligned_allocator<U>&) noexcept
+    {
+    }
+
+    T* allocate(std::size_t n)
+    {
+        if (n > (std::numeric_limits<std::size_t>::max() - (alignment - 1)) / sizeof(T))
+            throw std::bad_array_new_length();
+        std::size_t size = (n * sizeof(T) + alignment - 1) & ~(alignment - 1);
+        return static_cast<T*>(detail::allocate_aligned(size, alignment));
+    }
+
+    void deallocate(T* p, std::size_t) noexcept
+    {
+        detail::deallocate_aligned(p);
+    }
+};
+
+template<class T, class U>
+bool operator==(const cache_aligned_allocator<T>&, const cache_aligned_allocator<U>&)
+{
+    return true;
+}
+
+template<class T, class U>
+bool operator!=(const cache_aligned_allocator<T>&, const cache_aligned_allocator<U>&)
+{
+    return false;
+}
+
+namespace detail
+{
+    template<typename T>
+    struct cache_aligned_delete
+    {
+        void operator()(T* p) const
+        {
+            p->~T();
+            cache_aligned_allocator<T>().deallocate(p, 1);
+        }
+    };
+}
+
+//
+// make_safe_aligned
+//
+// make_safe for objects that are read on some cores while safe_ptrs to them
+// are copied on others. make_safe puts the reference counts and the first
+// bytes of the object on one cache line, so every copy or release takes
+// that line away from the readers. Here the object and the control block
+// are separate allocations from cache_aligned_allocator, each on lines of
+// its own, at the cost of a second allocation. Over-aligned T is honoured.
+//
+// T::make_safe hooks are not used, since they choose their own layout.
+//
+
+template<typename T, typename... Args>
+safe_ptr<T> make_safe_aligned(Args&&... args)
+{
+    SPL_INSTRUMENT_COUNT(T, allocations);
+    cache_aligned_allocator<T> alloc;
+    T* p = alloc.allocate(1);
+    try
+    {
+        ::new (static_cast<void*>(p)) T(std::forward<Args>(args)...);
+    }
+    catch (...)
+    {
+        alloc.deallocate(p, 1);
+        throw;
+    }
+    // destroys the object if allocating the control block throws
+    return detail::safe_ptr_access::adopt(std::shared_ptr<T>(p, detail::cache_aligned_delete<T>(), alloc));
+}
+
+} // namespace
@@ -0,0 +1,222 @@
+#pragma once
+
+#include "safe_ptr.hpp"
+
+#include <cstddef>
+#include <limits>
+#include <new>
+
+namespace spl
+{
+
+template<typename T> class safe_array;
+
+template<typename T, typename... Args>
+safe_array<T> make_safe_n(std::size_t n, const Args&... args);
+
+namespace detail
+{
+    // Allocator for allocate_shared that appends extra bytes after the
+    // control block and reports where they start through trailing, so that
+    // an array whose length is only known at run time can share the control
+    // block's allocation.
+    template<typename T>
+    struct trailing_allocator
+    {
+        typedef T value_type;
+
+        std::size_t extra;
+        void** trailing;
+
+        trailing_allocator(std::size_t e, void** t)
+            : extra(e), trailing(t)
+        {
+        }
+
+        template<typename U>
+        trailing_allocator(const trailing_allocator<U>& other)
+            : extra(other.extra), trailing(other.trailing)
+        {
+        }
+
+        static std::size_t offset()
+        {
+            const std::size_t align = alignof(std::max_align_t);
+            return (sizeof(T) + align - 1) / align * align;
+        }
+
+        T* allocate(std::size_t n)
+        {
+            assert(n == 1 && "allocate_shared allocates one control block");
+            if (n > (std::numeric_limits<std::size_t>::max() - extra) / offset())
+                throw std::bad_array_new_length();
+            char* p = static_cast<char*>(::operator new(n * offset() + extra));
+            *trailing = p + offset();
+            return reinterpret_cast<T*>(p);
+        }
+
+        void deallocate(T* p, std::size_t)
+        {
+            ::operator delete(p);
+        }
+    };
+
+    template<typename T, typename U>
+    bool operator==(const trailing_allocator<T>& a, const trailing_allocator<U>& b)
+    {
+        return a.trailing == b.trailing;
+    }
+
+    template<typename T, typename U>
+    bool operator!=(const trailing_allocator<T>& a, const trailing_allocator<U>& b)
+    {
+        return a.trailing != b.trailing;
+    }
+
+    // The n objects living in the trailing storage.
+    template<typename T>
+    struct trailing_array
+    {
+        T* first;
+        std::size_t size;
+
+        template<typename... Args>
+        trailing_array(void* const* storage, std::size_t n, const Args&... args)
+            : first(static_cast<T*>(*storage)), size(0)
+        {
+            try
+            {
+                for (; size < n; ++size)
+                    ::new (static_cast<void*>(first + size)) T(args...);
+            }
+            catch (...)
+            {
+                destroy();
+                throw;
+            }
+        }
+
+        ~trailing_array()
+        {
+            destroy();
+        }
+
+        void destroy()
+        {
+            while (size)
+                first[--size].~T();
+        }
+    };
+
+} // namespace detail
+
+//
+// safe_array
+//
+// A non-null owner of n > 0 contiguous objects that live and die together.
+// handle(i) gives a safe_ptr to one element that shares the array's control
+// block, so it costs one reference count increment and no allocation, and
+// keeps the whole array alive.
+//
+// As with safe_ptr, a moved-from safe_array may only be destroyed, assigned
+// to or swapped.
+//
+
+template<typename T>
+class safe_array
+{
+    template<typename U, typename... Args>
+    friend safe_array<U> make_safe_n(std::size_t n, const Args&... args);
+public:
+    typedef T  element_type;
+    typedef T  value_type;
+    typedef T* iterator;
+    typedef std::size_t size_type;
+
+    T* data() const
+    {
+        return first_.get();
+    }
+
+    std::size_t size() const
+    {
+        return size_;
+    }
+
+    T* begin() const
+    {
+        return data();
+    }
+
+    T* end() const
+    {
+        return data() + size_;
+    }
+
+    T& operator[](std::size_t i) const
+    {
+        assert(i < size_);
+        return data()[i];
+    }
+
+    safe_ptr<T> handle(std::size_t i) const
+    {
+        if (i >= size_)
+            throw std::out_of_range("i");
+        return detail::safe_ptr_access::alias(first_, data() + i);
+    }
+
+    long use_count() const
+    {
+        return first_.use_count();
+    }
+
+    void swap(safe_array& other) noexcept
+    {
+        first_.swap(other.first_);
+        std::swap(size_, other.size_);
+    }
+
+private:
+    safe_array(safe_ptr<T>&& first, std::size_t n) noexcept
+        : first_(std::move(first)), size_(n)
+    {
+    }
+
+    safe_ptr<T> first_;
+    std::size_t size_;
+};
+
+template<class T>
+void swap(safe_array<T>& a, safe_array<T>& b) noexcept
+{
+    a.swap(b);
+}
+
+//
+// make_safe_n
+//
+// Constructs n objects of type T, each from copies of args, in a single
+// allocation shared with their control block. T::make_safe hooks are not
+// used, since they create one object at a time.
+//
+
+template<typename T, typename... Args>
+safe_array<T> make_safe_n(std::size_t n, const Args&... args)
+{
+    static_assert(alignof(T) <= alignof(std::max_align_t), "make_safe_n does not support over-aligned types");
+
+    if (n == 0)
+        throw std::invalid_argument("n");
+    if (n > std::numeric_limits<std::size_t>::max() / sizeof(T))
+        throw std::bad_array_new_length();
+
+    typedef detail::trailing_array<T> block_type;
+    void* storage = 0;
+    std::shared_ptr<block_type> block = std::allocate_shared<block_type>(
+        detail::trailing_allocator<block_type>(n * sizeof(T), &storage), &storage, n, args...);
+    T* first = block->first;
+    return safe_array<T>(detail::safe_ptr_access::adopt(detail::alias(std::move(block), first)), n);
+}
+
+} // namespace
@@ -0,0 +1,323 @@
+#pragma once
+
+#include "safe_ptr.hpp"
+
+#include <atomic>
+
+namespace spl
+{
+
+//
+// safe_intrusive_ptr
+//
+// A non-null pointer one word wide that keeps its reference count inside the
+// pointed-to object. The count is managed through the unqualified functions
+// safe_intrusive_add_ref(p) and safe_intrusive_release(p), found by argument
+// dependent lookup; enable_safe_intrusive_from_this provides both.
+//
+// As with safe_ptr, a moved-from safe_intrusive_ptr holds null and may only
+// be destroyed, assigned to or swapped.
+//
+
+template<typename T>
+class safe_intrusive_ptr
+{
+    template <typename> friend class safe_intrusive_ptr;
+public:
+    typedef T  element_type;
+
+    // Takes a reference on p unless add_ref is false, in which case the
+    // caller's reference is adopted.
+    template<typename U>
+    explicit safe_intrusive_ptr(U* p, bool add_ref = true, typename std::enable_if<std::is_convertible<U*, T*>::value, void*>::type = 0)
+        : p_(p)
+    {
+        if (!p)
+            throw std::invalid_argument("p");
+        if (add_ref)
+            safe_intrusive_add_ref(p_);
+    }
+
+    safe_intrusive_ptr(const safe_intrusive_ptr& other) noexcept
+        : p_(other.get())
+    {
+        safe_intrusive_add_ref(p_);
+    }
+
+    safe_intrusive_ptr(safe_intrusive_ptr&& other) noexcept
+        : p_(other.p_)
+    {
+        other.p_ = 0;
+    }
+
+    template<typename U>
+    safe_intrusive_ptr(const safe_intrusive_ptr<U>& other, typename std::enable_if<std::is_convertible<U*, T*>::value, void*>::type = 0) noexcept
+        : p_(other.get())
+    {
+        safe_intrusive_add_ref(p_);
+    }
+
+    template<typename U>
+    safe_intrusive_ptr(safe_intrusive_ptr<U>&& other, typename std::enable_if<std::is_convertible<U*, T*>::value, void*>::type = 0) noexcept
+        : p_(other.p_)
+    {
+        other.p_ = 0;
+    }
+
+    ~safe_intrusive_ptr()
+    {
+        if (p_)
+            safe_intrusive_release(p_);
+    }
+
+    safe_intrusive_ptr& operator=(const safe_intrusive_ptr& other) noexcept
+    {
+        safe_intrusive_ptr(other).swap(*this);
+        return *this;
+    }
+
+    safe_intrusive_ptr& operator=(safe_intrusive_ptr&& other) noexcept
+    {
+        safe_intrusive_ptr(std::move(other)).swap(*this);
+        return *this;
+    }
+
+    template<typename U>
+    typename std::enable_if<std::is_convertible<U*, T*>::value, safe_intrusive_ptr&>::type
+    operator=(const safe_intrusive_ptr<U>& other) noexcept
+    {
+        safe_intrusive_ptr(other).swap(*this);
+        return *this;
+    }
+
+    template<typename U>
+    typename std::enable_if<std::is_convertible<U*, T*>::value, safe_intrusive_ptr&>::type
+    operator=(safe_intrusive_ptr<U>&& other) noexcept
+    {
+        safe_intrusive_ptr(std::move(other)).swap(*this);
+        return *this;
+    }
+
+    T& operator*() const
+    {
+        return *get();
+    }
+
+    T* operator->() const
+    {
+        return get();
+    }
+
+    T* get() const
+    {
+        assert(p_ && "use of moved-from safe_intrusive_ptr");
+        return p_;
+    }
+
+    bool unique() const
+    {
+        return use_count() == 1;
+    }
+
+    long use_count() const
+    {
+        return safe_intrusive_use_count(get());
+    }
+
+    void swap(safe_intrusive_ptr& other) noexcept
+    {
+        T* tmp = p_;
+        p_ = other.p_;
+        other.p_ = tmp;
+    }
+
+    // Gives up this pointer's reference without releasing it, leaving this
+    // safe_intrusive_ptr moved-from.
+    T* detach() noexcept
+    {
+        T* p = p_;
+        p_ = 0;
+        return p;
+    }
+
+private:
+    T* p_;
+};
+
+template<class T, class U>
+bool operator==(const safe_intrusive_ptr<T>& a, const safe_intrusive_ptr<U>& b)
+{
+    return a.get() == b.get();
+}
+
+template<class T, class U>
+bool operator!=(const safe_intrusive_ptr<T>& a, const safe_intrusive_ptr<U>& b)
+{
+    return a.get() != b.get();
+}
+
+template<class T, class U>
+bool operator<(const safe_intrusive_ptr<T>& a, const safe_intrusive_ptr<U>& b)
+{
+    return a.get() < b.get();
+}
+
+template<class T, class U>
+bool operator>(const safe_intrusive_ptr<T>& a, const safe_intrusive_ptr<U>& b)
+{
+    return a.get() > b.get();
+}
+
+template<class T, class U>
+bool operator>=(const safe_intrusive_ptr<T>& a, const safe_intrusive_ptr<U>& b)
+{
+    return a.get() >= b.get();
+}
+
+template<class T, class U>
+bool operator<=(const safe_intrusive_ptr<T>& a, const safe_intrusive_ptr<U>& b)
+{
+    return a.get() <= b.get();
+}
+
+template<class E, class T, class U>
+std::basic_ostream<E, T>& operator<<(std::basic_ostream<E, T>& out, const safe_intrusive_ptr<U>& p)
+{
+    return out << p.get();
+}
+
+template<class T>
+void swap(safe_intrusive_ptr<T>& a, safe_intrusive_ptr<T>& b) noexcept
+{
+    a.swap(b);
+}
+
+template<class T>
+T* get_pointer(safe_intrusive_ptr<T> const& p)
+{
+    return p.get();
+}
+
+template <class T, class U>
+safe_intrusive_ptr<T> static_pointer_cast(const safe_intrusive_ptr<U>& p)
+{
+    return safe_intrusive_ptr<T>(static_cast<T*>(p.get()));
+}
+
+template <class T, class U>
+safe_intrusive_ptr<T> static_pointer_cast(safe_intrusive_ptr<U>&& p)
+{
+    return safe_intrusive_ptr<T>(static_cast<T*>(p.detach()), false);
+}
+
+template <class T, class U>
+safe_intrusive_ptr<T> const_pointer_cast(const safe_intrusive_ptr<U>& p)
+{
+    return safe_intrusive_ptr<T>(const_cast<T*>(p.get()));
+}
+
+template <class T, class U>
+safe_intrusive_ptr<T> const_pointer_cast(safe_intrusive_ptr<U>&& p)
+{
+    return safe_intrusive_ptr<T>(const_cast<T*>(p.detach()), false);
+}
+
+template <class T, class U>
+safe_intrusive_ptr<T> dynamic_pointer_cast(const safe_intrusive_ptr<U>& p)
+{
+    T* t = dynamic_cast<T*>(p.get());
+    if(!t)
+        throw std::bad_cast();
+    return safe_intrusive_ptr<T>(t);
+}
+
+template <class T, class U>
+safe_intrusive_ptr<T> dynamic_pointer_cast(safe_intrusive_ptr<U>&& p)
+{
+    T* t = dynamic_cast<T*>(p.get());
+    if(!t)
+        throw std::bad_cast();
+    p.detach();
+    return safe_intrusive_ptr<T>(t, false);
+}
+
+//
+// enable_safe_intrusive_from_this
+//
+// Mixin that puts a thread-safe reference count in T, so that T can be held
+// by safe_intrusive_ptr and safe_from_this() needs neither a lookup nor an
+// allocation. The object must be allocated with new, normally through
+// make_safe_intrusive, and is deleted through a pointer to T, so classes
+// derived from T need a virtual destructor in T.
+//
+// Do not call safe_from_this() from a constructor, or on an object that no
+// safe_intrusive_ptr owns yet: the temporary reference would be the last.
+//
+
+template<class T>
+class enable_safe_intrusive_from_this
+{
+public:
+    safe_intrusive_ptr<T> safe_from_this()
+    {
+        return safe_intrusive_ptr<T>(static_cast<T*>(this));
+    }
+
+    safe_intrusive_ptr<T const> safe_from_this() const
+    {
+        return safe_intrusive_ptr<T const>(static_cast<T const*>(this));
+    }
+
+protected:
+    enable_safe_intrusive_from_this() noexcept
+        : count_(0)
+    {
+    }
+
+    enable_safe_intrusive_from_this(const enable_safe_intrusive_from_this&) noexcept
+        : count_(0)
+    {
+    }
+
+    enable_safe_intrusive_from_this& operator=(const enable_safe_intrusive_from_this&) noexcept
+    {
+        return *this;
+    }
+
+    ~enable_safe_intrusive_from_this()
+    {
+    }
+
+private:
+    friend void safe_intrusive_add_ref(const enable_safe_intrusive_from_this* p) noexcept
+    {
+        p->count_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    friend void safe_intrusive_release(const enable_safe_intrusive_from_this* p) noexcept
+    {
+        if (p->count_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            delete static_cast<const T*>(p);
+    }
+
+    friend long safe_intrusive_use_count(const enable_safe_intrusive_from_this* p) noexcept
+    {
+        return p->count_.load(std::memory_order_relaxed);
+    }
+
+    mutable std::atomic<long> count_;
+};
+
+//
+// make_safe_intrusive
+//
+// safe_intrusive_ptr equivalent to make_safe
+//
+
+template<typename T, typename... Args>
+safe_intrusive_ptr<T> make_safe_intrusive(Args&&... args)
+{
+    return safe_intrusive_ptr<T>(new T(std::forward<Args>(args)...));
+}
+
+} // namespace
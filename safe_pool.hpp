@@ -0,0 +1,358 @@
+#pragma once
+
+#include "safe_ptr.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <new>
+
+namespace spl
+{
+
+//
+// pool_traits
+//
+// Specialize to change how many free blocks of T each thread keeps.
+//
+
+template<typename T>
+struct pool_traits
+{
+    static const std::size_t max_cached = 1024;
+};
+
+//
+// pool_stats
+//
+// Counters of one thread's pool for one type.
+//
+
+struct pool_stats
+{
+    std::size_t hits;           // allocations served from the free list
+    std::size_t misses;         // allocations that went to the heap
+    std::size_t cached;         // free blocks held right now
+    std::size_t outstanding;    // blocks handed out and not yet back
+    std::size_t remote_returns; // blocks freed by other threads and taken back
+    std::size_t remote_batches; // times those were taken back
+
+    double hit_rate() const
+    {
+        std::size_t total = hits + misses;
+        return total ? double(hits) / double(total) : 0.0;
+    }
+};
+
+namespace detail
+{
+    //
+    // The free blocks of one type owned by one thread. Blocks freed on the
+    // owning thread go straight onto its free list; blocks freed elsewhere
+    // are pushed onto remote, and the owner takes that whole list back in
+    // one exchange when its own list runs dry.
+    //
+    // When the owning thread exits its free blocks go back to the heap and
+    // remote is closed with a sentinel. Blocks still in use elsewhere are then
+    // freed to the heap directly, and the last one deletes the pool_state.
+    //
+    class pool_state
+    {
+    public:
+        struct node
+        {
+            node* next;
+        };
+
+        // Every block starts with the pool_state that allocated it.
+        struct header
+        {
+            pool_state* owner;
+        };
+
+        static const std::size_t header_size =
+            (sizeof(header) + alignof(std::max_align_t) - 1) / alignof(std::max_align_t) * alignof(std::max_align_t);
+
+        explicit pool_state(std::size_t max_cached)
+            : local_(0), max_cached_(max_cached), remote_(0), orphan_refs_(0)
+        {
+            stats_ = pool_stats();
+        }
+
+        void* allocate(std::size_t size)
+        {
+            if (!local_)
+                take_remote();
+
+            if (node* n = local_)
+            {
+                local_ = n->next;
+                --stats_.cached;
+                ++stats_.hits;
+                ++stats_.outstanding;
+                return n;
+            }
+            void* p = new_block(this, size);
+            ++stats_.misses;
+            ++stats_.outstanding;
+            return p;
+        }
+
+        // Called on the owning thread only.
+        void deallocate_local(void* p)
+        {
+            --stats_.outstanding;
+            if (stats_.cached >= max_cached_)
+            {
+                delete_block(p);
+                return;
+            }
+            node* n = static_cast<node*>(p);
+            n->next = local_;
+            local_ = n;
+            ++stats_.cached;
+        }
+
+        void deallocate_remote(void* p)
+        {
+            node* n = static_cast<node*>(p);
+            node* head = remote_.load(std::memory_order_relaxed);
+            do
+            {
+                if (head == orphaned())
+                {
+                    delete_block(p);
+                    if (orphan_refs_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                        delete this;
+                    return;
+                }
+                n->next = head;
+            }
+            while (!remote_.compare_exchange_weak(head, n, std::memory_order_release, std::memory_order_relaxed));
+        }
+
+        // Called by the owning thread as it exits.
+        void orphan()
+        {
+            while (node* n = local_)
+            {
+                local_ = n->next;
+                delete_block(n);
+            }
+            stats_.cached = 0;
+
+            node* list = remote_.exchange(orphaned(), std::memory_order_acquire);
+            while (list)
+            {
+                node* next = list->next;
+                delete_block(list);
+                --stats_.outstanding;
+                list = next;
+            }
+
+            long remaining = static_cast<long>(stats_.outstanding);
+            if (orphan_refs_.fetch_add(remaining, std::memory_order_acq_rel) + remaining == 0)
+                delete this;
+        }
+
+        const pool_stats& stats() const
+        {
+            return stats_;
+        }
+
+        static void* new_block(pool_state* owner, std::size_t size)
+        {
+            char* raw = static_cast<char*>(::operator new(header_size + size));
+            reinterpret_cast<header*>(raw)->owner = owner;
+            return raw + header_size;
+        }
+
+        static void delete_block(void* p)
+        {
+            ::operator delete(static_cast<char*>(p) - header_size);
+        }
+
+        static pool_state* owner_of(void* p)
+        {
+            return reinterpret_cast<header*>(static_cast<char*>(p) - header_size)->owner;
+        }
+
+    private:
+        static node* orphaned()
+        {
+            return reinterpret_cast<node*>(1);
+        }
+
+        void take_remote()
+        {
+            node* list = remote_.exchange(0, std::memory_order_acquire);
+            if (!list)
+                return;
+            ++stats_.remote_batches;
+            while (list)
+            {
+                node* next = list->next;
+                ++stats_.remote_returns;
+                deallocate_local(list);
+                list = next;
+            }
+        }
+
+        node* local_;
+        std::size_t max_cached_;
+        pool_stats stats_;
+        std::atomic<node*> remote_;
+        std::atomic<long> orphan_refs_;
+    };
+
+    // Trivially destructible, so still usable while the thread's other
+    // thread_local objects are being destroyed.
+    template<typename Tag>
+    struct pool_thread_state
+    {
+        static pool_state*& current()
+        {
+            static thread_local pool_state* s = 0;
+            return s;
+        }
+
+        static bool& exiting()
+        {
+            static thread_local bool e = false;
+            return e;
+        }
+    };
+
+    // The calling thread's pool for Tag, or null once the thread is exiting.
+    template<typename Tag>
+    pool_state* local_pool()
+    {
+        typedef pool_thread_state<Tag> thread_state;
+
+        struct holder
+        {
+            pool_state* state;
+
+            holder()
+                : state(new pool_state(pool_traits<Tag>::max_cached))
+            {
+            }
+
+            ~holder()
+            {
+                thread_state::current() = 0;
+                thread_state::exiting() = true;
+                state->orphan();
+            }
+        };
+
+        pool_state* s = thread_state::current();
+        if (!s && !thread_state::exiting())
+        {
+            static thread_local holder h;
+            s = thread_state::current() = h.state;
+        }
+        return s;
+    }
+
+    template<typename U, typename Tag>
+    struct pool_allocator
+    {
+        typedef U value_type;
+
+        template<typename V>
+        struct rebind
+        {
+            typedef pool_allocator<V, Tag> other;
+        };
+
+        pool_allocator()
+        {
+        }
+
+        template<typename V>
+        pool_allocator(const pool_allocator<V, Tag>&)
+        {
+        }
+
+        U* allocate(std::size_t n)
+        {
+            static_assert(alignof(U) <= alignof(std::max_align_t), "pool_make_safe does not support over-aligned types");
+            assert(n == 1 && "allocate_shared allocates one control block");
+            if (pool_state* pool = local_pool<Tag>())
+                return static_cast<U*>(pool->allocate(n * sizeof(U)));
+            return static_cast<U*>(pool_state::new_block(0, n * sizeof(U)));
+        }
+
+        void deallocate(U* p, std::size_t)
+        {
+            pool_state* owner = pool_state::owner_of(p);
+            if (!owner)
+                pool_state::delete_block(p);
+            else if (owner == pool_thread_state<Tag>::current())
+                owner->deallocate_local(p);
+            else
+                owner->deallocate_remote(p);
+        }
+    };
+
+    template<typename U, typename V, typename Tag>
+    bool operator==(const pool_allocator<U, Tag>&, const pool_allocator<V, Tag>&)
+    {
+        return true;
+    }
+
+    template<typename U, typename V, typename Tag>
+    bool operator!=(const pool_allocator<U, Tag>&, const pool_allocator<V, Tag>&)
+    {
+        return false;
+    }
+
+} // namespace detail
+
+//
+// pool_make_safe
+//
+// make_safe for short-lived objects of hot types. The object and its
+// control block come from a per-thread free list of T's blocks, and go back
+// onto the free list of the thread that allocated them when the last
+// safe_ptr goes away. Blocks released on other threads are handed back in
+// batches.
+//
+// Like make_safe_by_key in the tests, T's constructor must be reachable from
+// std::allocate_shared; a private constructor needs a key argument instead.
+//
+
+template<typename T, typename... Args>
+safe_ptr<T> pool_make_safe(Args&&... args)
+{
+    return detail::safe_ptr_access::adopt(
+        std::allocate_shared<T>(detail::pool_allocator<T, T>(), std::forward<Args>(args)...));
+}
+
+// The calling thread's pool counters for T.
+template<typename T>
+pool_stats pool_stats_for()
+{
+    detail::pool_state* pool = detail::local_pool<T>();
+    return pool ? pool->stats() : pool_stats();
+}
+
+//
+// make_safe_from_pool
+//
+// Base class that makes make_safe<T> use pool_make_safe<T>. The hook only
+// takes arguments T can be constructed from, so detail::has_make_safe stays
+// false for any other argument list.
+//
+
+template<typename T>
+struct make_safe_from_pool
+{
+    template<class... Args>
+    static typename std::enable_if<std::is_constructible<T, Args...>::value, safe_ptr<T> >::type make_safe(Args&&... args)
+    {
+        return pool_make_safe<T>(std::forward<Args>(args)...);
+    }
+};
+
+} // namespace
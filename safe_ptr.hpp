@@ -1,34 +1,109 @@
 #pragma once
 
+#include <cassert>
+#include <cstdint>
+#include <functional>
+#include <iterator>
 #include <memory>
 #include <stdexcept>
 #include <type_traits>
+#include <typeinfo>
 
-#if defined(__VARIADIC_TEMPLATES) || (defined(__GNUC__) && defined(__GXX_EXPERIMENTAL_CXX0X__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ > 2)))
-#define SPL_HAS_VARIADIC_TEMPLATES
+#if defined(__has_include)
+#if __cplusplus >= 201703L && __has_include(<memory_resource>)
+#include <memory_resource>
+#define SPL_HAS_MEMORY_RESOURCE
+#endif
+#endif
+
+// C++20 lets std::shared_ptr's aliasing constructor steal ownership from an
+// rvalue instead of copying it.
+#if !defined(SPL_HAS_SHARED_PTR_MOVE_ALIASING) && __cplusplus > 201703L
+#define SPL_HAS_SHARED_PTR_MOVE_ALIASING
+#endif
+
+// Counters of safe_ptr operations, see safe_ptr_instrument.hpp
+#ifdef SPL_SAFE_PTR_INSTRUMENT
+#include "safe_ptr_instrument.hpp"
+#else
+#define SPL_INSTRUMENT_COUNT(T, e) ((void)0)
 #endif
 
 namespace spl
 {
 
+template<typename T> class safe_ptr;
+template<typename T> class maybe_safe_ptr;
+
+namespace detail
+{
+    struct safe_ptr_access;
+
+    struct unchecked_tag {};
+
+    template<typename T, typename U>
+    std::shared_ptr<T> alias(const std::shared_ptr<U>& own, T* p)
+    {
+        return std::shared_ptr<T>(own, p);
+    }
+
+    template<typename T, typename U>
+    std::shared_ptr<T> alias(std::shared_ptr<U>&& own, T* p)
+    {
+    #ifdef SPL_HAS_SHARED_PTR_MOVE_ALIASING
+        return std::shared_ptr<T>(std::move(own), p);
+    #else
+        std::shared_ptr<T> result(own, p);
+        own.reset();
+        return result;
+    #endif
+    }
+}
+
+//
+// safe_ptr
+//
+// A moved-from safe_ptr is the only safe_ptr that holds null. It may only be
+// destroyed, assigned to or swapped; any other use is caught by assert in
+// debug builds.
+//
+
 template<typename T>
 class safe_ptr
 {
     template <typename> friend class safe_ptr;
+    friend struct detail::safe_ptr_access;
 public:
     typedef T  element_type;
 
-    safe_ptr(); // will construct new T object using make_safe<T>()
+    safe_ptr(); // will construct new T object using make_safe<T>(), see share_default_instance
 
     safe_ptr(const safe_ptr& other)
         : p_(other.p_)
     {
+        assert(p_ && "copy of moved-from safe_ptr");
+        SPL_INSTRUMENT_COUNT(T, copies);
+    }
+
+    safe_ptr(safe_ptr&& other) noexcept
+        : p_(std::move(other.p_))
+    {
+        SPL_INSTRUMENT_COUNT(T, moves);
     }
 
     template<typename U>
     safe_ptr(const safe_ptr<U>& other, typename std::enable_if<std::is_convertible<U*, T*>::value, void*>::type = 0)
         : p_(other.p_)
     {
+        assert(p_ && "copy of moved-from safe_ptr");
+        SPL_INSTRUMENT_COUNT(T, copies);
+    }
+
+    template<typename U>
+    safe_ptr(safe_ptr<U>&& other, typename std::enable_if<std::is_convertible<U*, T*>::value, void*>::type = 0) noexcept
+        : p_(std::move(other.p_))
+    {
+        SPL_INSTRUMENT_COUNT(T, moves);
     }
 
     template<typename U>
@@ -36,7 +111,10 @@ public:
         : p_(p)
     {
         if (!p)
+        {
+            SPL_INSTRUMENT_COUNT(T, null_throws);
             throw std::invalid_argument("p");
+        }
     }
 
     template<typename U>
@@ -44,7 +122,10 @@ public:
         : p_(std::move(p))
     {
         if (!p_)
+        {
+            SPL_INSTRUMENT_COUNT(T, null_throws);
             throw std::invalid_argument("p");
+        }
     }
 
     template<typename U>
@@ -52,7 +133,10 @@ public:
         : p_(std::move(p))
     {
         if (!p_)
+        {
+            SPL_INSTRUMENT_COUNT(T, null_throws);
             throw std::invalid_argument("p");
+        }
     }
 
     template<typename U>
@@ -60,7 +144,10 @@ public:
         : p_(p)
     {
         if (!p)
+        {
+            SPL_INSTRUMENT_COUNT(T, null_throws);
             throw std::invalid_argument("p");
+        }
     }
 
     template<typename U, typename D>
@@ -68,15 +155,35 @@ public:
         : p_(p, d)
     {
         if (!p)
+        {
+            SPL_INSTRUMENT_COUNT(T, null_throws);
             throw std::invalid_argument("p");
+        }
     }
 
     template<typename U>
     safe_ptr(safe_ptr<U> const& own, T * p)
-        : p_(static_cast<std::shared_ptr<U>>(own), p)
+        : p_(detail::alias(own.p_, checked(p)))
     {
-        if (!p)
-            throw std::invalid_argument("p");
+    }
+
+    template<typename U>
+    safe_ptr(safe_ptr<U>&& own, T * p)
+        : p_(detail::alias(std::move(own.p_), checked(p)))
+    {
+    }
+
+    safe_ptr& operator=(const safe_ptr& other)
+    {
+        safe_ptr(other).swap(*this);
+        return *this;
+    }
+
+    safe_ptr& operator=(safe_ptr&& other) noexcept
+    {
+        SPL_INSTRUMENT_COUNT(T, moves);
+        p_ = std::move(other.p_);
+        return *this;
     }
 
     template<typename U>
@@ -89,30 +196,33 @@ public:
 
     template<typename U>
     typename std::enable_if<std::is_convertible<U*, T*>::value, safe_ptr&>::type
-    operator=(safe_ptr<U>&& other)
+    operator=(safe_ptr<U>&& other) noexcept
     {
-        safe_ptr<T>(std::move(other)).swap(*this);
+        SPL_INSTRUMENT_COUNT(T, moves);
+        p_ = std::move(other.p_);
         return *this;
     }
 
     T& operator*() const
     {
-        return *p_.get();
+        return *get();
     }
 
     T* operator->() const
     {
-        return p_.get();
+        return get();
     }
 
     T* get() const
     {
+        assert(p_ && "use of moved-from safe_ptr");
         return p_.get();
     }
 
+    // std::shared_ptr::unique() is gone in C++20
     bool unique() const
     {
-        return p_.unique();
+        return use_count() == 1;
     }
 
     long use_count() const
@@ -120,57 +230,137 @@ public:
         return p_.use_count();
     }
 
-    void swap(safe_ptr& other)
+    void swap(safe_ptr& other) noexcept
     {
         p_.swap(other.p_);
     }
 
-    operator std::shared_ptr<T>() const
+    // Moves ownership out into a std::shared_ptr without touching the
+    // reference count. Leaves this safe_ptr moved-from.
+    std::shared_ptr<T> into_shared() && noexcept
     {
+        SPL_INSTRUMENT_COUNT(T, shared_conversions);
+        return std::move(p_);
+    }
+
+    operator std::shared_ptr<T>() const &
+    {
+        SPL_INSTRUMENT_COUNT(T, shared_conversions);
         return p_;
     }
 
+    operator std::shared_ptr<T>() && noexcept
+    {
+        SPL_INSTRUMENT_COUNT(T, shared_conversions);
+        return std::move(p_);
+    }
+
     operator std::weak_ptr<T>() const
     {
+        SPL_INSTRUMENT_COUNT(T, weak_conversions);
         return std::weak_ptr<T>(p_);
     }
 
     template<typename D, typename = typename
         std::enable_if<std::is_convertible<T*, D*>::value>::type>
-    operator std::shared_ptr<D>() const
+    operator std::shared_ptr<D>() const &
     {
+        SPL_INSTRUMENT_COUNT(T, shared_conversions);
         return p_;
     }
 
+    template<typename D, typename = typename
+        std::enable_if<std::is_convertible<T*, D*>::value>::type>
+    operator std::shared_ptr<D>() && noexcept
+    {
+        SPL_INSTRUMENT_COUNT(T, shared_conversions);
+        return std::move(p_);
+    }
+
     template<typename D, typename = typename
         std::enable_if<std::is_convertible<T*, D*>::value>::type>
     operator std::weak_ptr<D>() const
     {
+        SPL_INSTRUMENT_COUNT(T, weak_conversions);
         return std::weak_ptr<D>(p_);
     }
 
     template<class U>
-    bool owner_before(const safe_ptr& ptr)
+    bool owner_before(const safe_ptr<U>& ptr) const noexcept
     {
         return p_.owner_before(ptr.p_);
     }
 
     template<class U>
-    bool owner_before(const std::shared_ptr<U>& ptr)
+    bool owner_before(const std::shared_ptr<U>& ptr) const noexcept
+    {
+        return p_.owner_before(ptr);
+    }
+
+    template<class U>
+    bool owner_before(const std::weak_ptr<U>& ptr) const noexcept
     {
         return p_.owner_before(ptr);
     }
 
-    template<class D, class U>
-    D* get_deleter(safe_ptr<U> const& ptr)
+#ifdef __cpp_lib_smart_ptr_owner_equality
+    std::size_t owner_hash() const noexcept
     {
-        return p_.get_deleter();
+        return p_.owner_hash();
     }
+#endif
 
 private:
+    safe_ptr(std::shared_ptr<T>&& p, detail::unchecked_tag) noexcept
+        : p_(std::move(p))
+    {
+    }
+
+    static T* checked(T* p)
+    {
+        if (!p)
+        {
+            SPL_INSTRUMENT_COUNT(T, null_throws);
+            throw std::invalid_argument("p");
+        }
+        return p;
+    }
+
     std::shared_ptr<T> p_;
 };
 
+namespace detail
+{
+    // Lets the free functions below build a safe_ptr from a pointer already
+    // known to be non-null without checking it again.
+    struct safe_ptr_access
+    {
+        template<typename T, typename U>
+        static safe_ptr<T> alias(const safe_ptr<U>& own, T* p)
+        {
+            return safe_ptr<T>(detail::alias(own.p_, p), unchecked_tag());
+        }
+
+        template<typename T, typename U>
+        static safe_ptr<T> alias(safe_ptr<U>&& own, T* p)
+        {
+            return safe_ptr<T>(detail::alias(std::move(own.p_), p), unchecked_tag());
+        }
+
+        template<typename T>
+        static safe_ptr<T> adopt(std::shared_ptr<T>&& p)
+        {
+            return safe_ptr<T>(std::move(p), unchecked_tag());
+        }
+
+        template<typename T>
+        static const std::shared_ptr<T>& shared(const safe_ptr<T>& p)
+        {
+            return p.p_;
+        }
+    };
+}
+
 template<class T, class U>
 bool operator==(const safe_ptr<T>& a, const safe_ptr<U>& b)
 {
@@ -286,7 +476,7 @@ std::basic_ostream<E, T>& operator<<(std::basic_ostream<E, T>& out, const safe_p
 }
 
 template<class T>
-void swap(safe_ptr<T>& a, safe_ptr<T>& b)
+void swap(safe_ptr<T>& a, safe_ptr<T>& b) noexcept
 {
     a.swap(b);
 }
@@ -297,311 +487,1071 @@ T* get_pointer(safe_ptr<T> const& p)
     return p.get();
 }
 
+// The deleter p was created with, as std::get_deleter; null if it was not
+// created with a deleter of type D.
+template<class D, class T>
+D* get_deleter(safe_ptr<T> const& p) noexcept
+{
+    return std::get_deleter<D>(detail::safe_ptr_access::shared(p));
+}
+
+//
+// static_safe_ptr
+//
+// A safe_ptr to an object that the caller guarantees will outlive every copy,
+// such as a singleton or a global table. It has no control block: nothing is
+// allocated, and copying or destroying it touches no reference count, so
+// copies on different cores share nothing but the object itself. Otherwise
+// it is an ordinary safe_ptr<T>. use_count() is 0, a weak_safe_ptr made from
+// it is always expired, owner_less sees all of them as one owner, and
+// safe_from_this() cannot be used on the object.
+//
+
+template<class T>
+safe_ptr<T> static_safe_ptr(T& object) noexcept
+{
+    return detail::safe_ptr_access::adopt(std::shared_ptr<T>(std::shared_ptr<void>(), std::addressof(object)));
+}
+
+//
+// pointer casts
+//
+// The const& overloads cost one reference count increment. The && overloads
+// take ownership from their argument; on C++20 they cost no reference count
+// traffic, before that one increment and one decrement. A failed
+// dynamic_pointer_cast throws std::bad_cast and leaves its argument intact.
+//
+
 template <class T, class U>
 safe_ptr<T> static_pointer_cast(const safe_ptr<U>& p)
 {
-    return safe_ptr<T>(std::static_pointer_cast<T>(std::shared_ptr<U>(p)));
+    SPL_INSTRUMENT_COUNT(T, casts);
+    return detail::safe_ptr_access::alias(p, static_cast<T*>(p.get()));
+}
+
+template <class T, class U>
+safe_ptr<T> static_pointer_cast(safe_ptr<U>&& p)
+{
+    SPL_INSTRUMENT_COUNT(T, casts);
+    T* t = static_cast<T*>(p.get());
+    return detail::safe_ptr_access::alias(std::move(p), t);
 }
 
 template <class T, class U>
 safe_ptr<T> const_pointer_cast(const safe_ptr<U>& p)
 {
-    return safe_ptr<T>(std::const_pointer_cast<T>(std::shared_ptr<U>(p)));
+    SPL_INSTRUMENT_COUNT(T, casts);
+    return detail::safe_ptr_access::alias(p, const_cast<T*>(p.get()));
+}
+
+template <class T, class U>
+safe_ptr<T> const_pointer_cast(safe_ptr<U>&& p)
+{
+    SPL_INSTRUMENT_COUNT(T, casts);
+    T* t = const_cast<T*>(p.get());
+    return detail::safe_ptr_access::alias(std::move(p), t);
 }
 
 template <class T, class U>
 safe_ptr<T> dynamic_pointer_cast(const safe_ptr<U>& p)
 {
-    auto temp = std::dynamic_pointer_cast<T>(std::shared_ptr<U>(p));
-    if(!temp)
+    SPL_INSTRUMENT_COUNT(T, casts);
+    T* t = dynamic_cast<T*>(p.get());
+    if(!t)
+        throw std::bad_cast();
+    return detail::safe_ptr_access::alias(p, t);
+}
+
+template <class T, class U>
+safe_ptr<T> dynamic_pointer_cast(safe_ptr<U>&& p)
+{
+    SPL_INSTRUMENT_COUNT(T, casts);
+    T* t = dynamic_cast<T*>(p.get());
+    if(!t)
         throw std::bad_cast();
-    return safe_ptr<T>(std::move(temp));
+    return detail::safe_ptr_access::alias(std::move(p), t);
 }
 
 //
-// enable_safe_this
+// maybe_safe_ptr
 //
-// A safe_ptr version of enable_shared_from_this.
-// So that an object may get safe_ptr objects to itself.
+// A nullable companion to safe_ptr for results that may legitimately be
+// absent, such as a failed try_dynamic_pointer_cast. It is a std::shared_ptr
+// underneath, so converting a non-empty maybe_safe_ptr back to a safe_ptr
+// costs no allocation and, from an rvalue, no reference count traffic.
 //
 
-template<class T>
-class enable_safe_from_this : public std::enable_shared_from_this<T>
+template<typename T>
+class maybe_safe_ptr
 {
+    template <typename> friend class maybe_safe_ptr;
 public:
-    safe_ptr<T> safe_from_this()
+    typedef T  element_type;
+
+    maybe_safe_ptr() noexcept
     {
-        return safe_ptr<T>(this->shared_from_this());
     }
 
-    safe_ptr<T const> safe_from_this() const
+    maybe_safe_ptr(std::nullptr_t) noexcept
     {
-        return safe_ptr<T const>(this->shared_from_this());
     }
-protected:
-    enable_safe_from_this()
+
+    template<typename U>
+    maybe_safe_ptr(const safe_ptr<U>& p, typename std::enable_if<std::is_convertible<U*, T*>::value, void*>::type = 0)
+        : p_(detail::safe_ptr_access::shared(p))
     {
     }
 
-    enable_safe_from_this(const enable_safe_from_this&)
+    template<typename U>
+    maybe_safe_ptr(safe_ptr<U>&& p, typename std::enable_if<std::is_convertible<U*, T*>::value, void*>::type = 0) noexcept
+        : p_(std::move(p).into_shared())
     {
     }
 
-    enable_safe_from_this& operator=(const enable_safe_from_this&)
+    template<typename U>
+    maybe_safe_ptr(const maybe_safe_ptr<U>& other, typename std::enable_if<std::is_convertible<U*, T*>::value, void*>::type = 0)
+        : p_(other.p_)
     {
-        return *this;
     }
 
-    ~enable_safe_from_this ()
+    template<typename U>
+    maybe_safe_ptr(maybe_safe_ptr<U>&& other, typename std::enable_if<std::is_convertible<U*, T*>::value, void*>::type = 0) noexcept
+        : p_(std::move(other.p_))
     {
     }
-};
-
-namespace detail
-{
-    template<typename T>
-    T && forward_type();
 
-    struct specialization_tag {};
-
-    template<class MakeSafeReturnType>
-    struct specialize_if_exist
+    template<typename U>
+    explicit maybe_safe_ptr(std::shared_ptr<U> p, typename std::enable_if<std::is_convertible<U*, T*>::value, void*>::type = 0) noexcept
+        : p_(std::move(p))
     {
-        typedef specialization_tag type;
-
-        static_assert( std::is_same<MakeSafeReturnType,
-                                    safe_ptr<typename MakeSafeReturnType::element_type>
-                       >::value, "make_safe should return a safe_ptr" );
-    };
-
-    #define DEFAULT_MAKE_SAFE_IMPL(Args___args, forward___)                       \
-    {                                                                             \
-        static safe_ptr<T> make_safe(Args___args)                                 \
-        {                                                                         \
-            return safe_ptr<T>(std::make_shared<T>(forward___));                  \
-        }                                                                         \
-    };
+    }
 
-    // specialization tag for when appropriate T::make_safe exists
-    #define SPECIALIZATION_TAG(forward_type___)                                   \
-    typename specialize_if_exist<decltype(T::make_safe(forward_type___)) >::type
+    explicit operator bool() const noexcept
+    {
+        return p_ != nullptr;
+    }
 
-    #define SPECIAL_MAKE_SAFE_IMPL(Args___args, forward___)                       \
-    {                                                                             \
-        static safe_ptr<T> make_safe(Args___args)                                 \
-        {                                                                         \
-            return T::make_safe(forward___);                                      \
-        }                                                                         \
-    };
+    bool has_value() const noexcept
+    {
+        return p_ != nullptr;
+    }
 
-    #ifdef SPL_HAS_VARIADIC_TEMPLATES
+    T& operator*() const
+    {
+        assert(p_ && "dereference of empty maybe_safe_ptr");
+        return *p_;
+    }
 
-    // default implementation when appropriate T::make_safe does not exist
-    template<typename SpecializationTag, typename T, typename... Args>
-    struct make_safe_impl
-    DEFAULT_MAKE_SAFE_IMPL(Args&&... args, std::forward<Args>(args)...);
+    T* operator->() const
+    {
+        assert(p_ && "dereference of empty maybe_safe_ptr");
+        return p_.get();
+    }
 
-    // specialization if appropriate T::make_safe exists
-    template<typename T, typename... Args>
-    struct make_safe_impl<SPECIALIZATION_TAG(forward_type<Args>()...), T, Args...>
-    SPECIAL_MAKE_SAFE_IMPL(Args&&... args, std::forward<Args>(args)...);
+    T* get() const noexcept
+    {
+        return p_.get();
+    }
 
-    #else
+    safe_ptr<T> value() const &
+    {
+        if (!p_)
+            throw std::logic_error("empty maybe_safe_ptr");
+        return detail::safe_ptr_access::adopt(std::shared_ptr<T>(p_));
+    }
 
-    namespace t0 {
-        #define ARGS___ARGS
-        #define FORWARD___
-        #define FORWARDTYPE___
+    safe_ptr<T> value() &&
+    {
+        if (!p_)
+            throw std::logic_error("empty maybe_safe_ptr");
+        return detail::safe_ptr_access::adopt(std::move(p_));
+    }
 
-        template<typename SpecializationTag, typename T>
-        struct make_safe_impl
-        DEFAULT_MAKE_SAFE_IMPL(ARGS___ARGS, FORWARD___);
+    safe_ptr<T> value_or(safe_ptr<T> fallback) const &
+    {
+        if (!p_)
+            return fallback;
+        return detail::safe_ptr_access::adopt(std::shared_ptr<T>(p_));
+    }
 
-        template<typename T>
-        struct make_safe_impl<SPECIALIZATION_TAG(FORWARDTYPE___), T>
-        SPECIAL_MAKE_SAFE_IMPL(ARGS___ARGS, FORWARD___);
-
-        #undef ARGS___ARGS
-        #undef FORWARD___
-        #undef FORWARDTYPE___
-    }
-
-    namespace t1 {
-        #define ARGS___            A0
-        #define TYPENAME___ARGS    typename A0
-        #define ARGS___ARGS        A0&& a0
-        #define FORWARD___         std::forward<A0>(a0)
-        #define FORWARDTYPE___     forward_type<A0>()
-
-        template<typename SpecializationTag, typename T, TYPENAME___ARGS>
-        struct make_safe_impl
-        DEFAULT_MAKE_SAFE_IMPL(ARGS___ARGS, FORWARD___);
-
-        template<typename T, TYPENAME___ARGS>
-        struct make_safe_impl<SPECIALIZATION_TAG(FORWARDTYPE___), T, ARGS___>
-        SPECIAL_MAKE_SAFE_IMPL(ARGS___ARGS, FORWARD___);
-
-        #undef ARGS___
-        #undef TYPENAME___ARGS
-        #undef ARGS___ARGS
-        #undef FORWARD___
-        #undef FORWARDTYPE___
-    }
-
-    namespace t2 {
-        #define ARGS___            A0, A1
-        #define TYPENAME___ARGS    typename A0, typename A1
-        #define ARGS___ARGS        A0&& a0, A1&& a1
-        #define FORWARD___         std::forward<A0>(a0), std::forward<A1>(a1)
-        #define FORWARDTYPE___     forward_type<A0>(), forward_type<A1>()
-
-        template<typename SpecializationTag, typename T, TYPENAME___ARGS>
-        struct make_safe_impl
-        DEFAULT_MAKE_SAFE_IMPL(ARGS___ARGS, FORWARD___);
-
-        template<typename T, TYPENAME___ARGS>
-        struct make_safe_impl<SPECIALIZATION_TAG(FORWARDTYPE___), T, ARGS___>
-        SPECIAL_MAKE_SAFE_IMPL(ARGS___ARGS, FORWARD___);
-
-        #undef ARGS___
-        #undef TYPENAME___ARGS
-        #undef ARGS___ARGS
-        #undef FORWARD___
-        #undef FORWARDTYPE___
-    }
-
-    namespace t3 {
-        #define ARGS___            A0, A1, A2
-        #define TYPENAME___ARGS    typename A0, typename A1, typename A2
-        #define ARGS___ARGS        A0&& a0, A1&& a1, A2&& a2
-        #define FORWARD___         std::forward<A0>(a0), std::forward<A1>(a1), std::forward<A2>(a2)
-        #define FORWARDTYPE___     forward_type<A0>(), forward_type<A1>(), forward_type<A2>()
-
-        template<typename SpecializationTag, typename T, TYPENAME___ARGS>
-        struct make_safe_impl
-        DEFAULT_MAKE_SAFE_IMPL(ARGS___ARGS, FORWARD___);
-
-        template<typename T, TYPENAME___ARGS>
-        struct make_safe_impl<SPECIALIZATION_TAG(FORWARDTYPE___), T, ARGS___>
-        SPECIAL_MAKE_SAFE_IMPL(ARGS___ARGS, FORWARD___);
-
-        #undef ARGS___
-        #undef TYPENAME___ARGS
-        #undef ARGS___ARGS
-        #undef FORWARD___
-        #undef FORWARDTYPE___
-    }
-
-    namespace t4 {
-        #define ARGS___            A0, A1, A2, A3
-        #define TYPENAME___ARGS    typename A0, typename A1, typename A2, typename A3
-        #define ARGS___ARGS        A0&& a0, A1&& a1, A2&& a2, A3&& a3
-        #define FORWARD___         std::forward<A0>(a0), std::forward<A1>(a1), std::forward<A2>(a2), std::forward<A3>(a3)
-        #define FORWARDTYPE___     forward_type<A0>(), forward_type<A1>(), forward_type<A2>(), forward_type<A3>()
-
-        template<typename SpecializationTag, typename T, TYPENAME___ARGS>
-        struct make_safe_impl
-        DEFAULT_MAKE_SAFE_IMPL(ARGS___ARGS, FORWARD___);
-
-        template<typename T, TYPENAME___ARGS>
-        struct make_safe_impl<SPECIALIZATION_TAG(FORWARDTYPE___), T, ARGS___>
-        SPECIAL_MAKE_SAFE_IMPL(ARGS___ARGS, FORWARD___);
-
-        #undef ARGS___
-        #undef TYPENAME___ARGS
-        #undef ARGS___ARGS
-        #undef FORWARD___
-        #undef FORWARDTYPE___
-    }
-
-    namespace t5 {
-        #define ARGS___            A0, A1, A2, A3, A4
-        #define TYPENAME___ARGS    typename A0, typename A1, typename A2, typename A3, typename A4
-        #define ARGS___ARGS        A0&& a0, A1&& a1, A2&& a2, A3&& a3, A4&& a4
-        #define FORWARD___         std::forward<A0>(a0), std::forward<A1>(a1), std::forward<A2>(a2), std::forward<A3>(a3), std::forward<A4>(a4)
-        #define FORWARDTYPE___     forward_type<A0>(), forward_type<A1>(), forward_type<A2>(), forward_type<A3>(), forward_type<A4>()
-
-        template<typename SpecializationTag, typename T, TYPENAME___ARGS>
-        struct make_safe_impl
-        DEFAULT_MAKE_SAFE_IMPL(ARGS___ARGS, FORWARD___);
-
-        template<typename T, TYPENAME___ARGS>
-        struct make_safe_impl<SPECIALIZATION_TAG(FORWARDTYPE___), T, ARGS___>
-        SPECIAL_MAKE_SAFE_IMPL(ARGS___ARGS, FORWARD___);
-
-        #undef ARGS___
-        #undef TYPENAME___ARGS
-        #undef ARGS___ARGS
-        #undef FORWARD___
-        #undef FORWARDTYPE___
+    safe_ptr<T> value_or(safe_ptr<T> fallback) &&
+    {
+        if (!p_)
+            return fallback;
+        return detail::safe_ptr_access::adopt(std::move(p_));
     }
 
-    #endif
+    void reset() noexcept
+    {
+        p_.reset();
+    }
 
-    #undef DEFAULT_MAKE_SAFE_IMPL
-    #undef SPECIAL_MAKE_SAFE_IMPL
+    void swap(maybe_safe_ptr& other) noexcept
+    {
+        p_.swap(other.p_);
+    }
 
-} // namespace detail
+    operator std::shared_ptr<T>() const &
+    {
+        return p_;
+    }
 
-//
-// make_safe
-//
-// safe_ptr equivalents to make_shared
-//
+    operator std::shared_ptr<T>() && noexcept
+    {
+        return std::move(p_);
+    }
 
-#ifdef SPL_HAS_VARIADIC_TEMPLATES
+private:
+    std::shared_ptr<T> p_;
+};
 
-template<typename T, typename... Args>
-safe_ptr<T> make_safe(Args&&... args)
+template<class T, class U>
+bool operator==(const maybe_safe_ptr<T>& a, const maybe_safe_ptr<U>& b)
 {
-    return detail::make_safe_impl<detail::specialization_tag, T, Args...>::make_safe(std::forward<Args>(args)...);
+    return a.get() == b.get();
 }
 
-#else
-
-template<typename T>
-safe_ptr<T> make_safe()
+template<class T, class U>
+bool operator!=(const maybe_safe_ptr<T>& a, const maybe_safe_ptr<U>& b)
 {
-    return detail::t0::make_safe_impl<detail::specialization_tag, T>::make_safe();
+    return a.get() != b.get();
 }
 
-template<typename T, typename P0>
-safe_ptr<T> make_safe(P0&& p0)
+template<class T>
+bool operator==(const maybe_safe_ptr<T>& a, std::nullptr_t)
 {
-    return detail::t1::make_safe_impl<detail::specialization_tag, T, P0>::make_safe(std::forward<P0>(p0));
+    return !a;
 }
 
-template<typename T, typename P0, typename P1>
-safe_ptr<T> make_safe(P0&& p0, P1&& p1)
+template<class T>
+bool operator!=(const maybe_safe_ptr<T>& a, std::nullptr_t)
 {
-    return detail::t2::make_safe_impl<detail::specialization_tag, T, P0, P1>::make_safe(std::forward<P0>(p0), std::forward<P1>(p1));
+    return static_cast<bool>(a);
 }
 
-template<typename T, typename P0, typename P1, typename P2>
-safe_ptr<T> make_safe(P0&& p0, P1&& p1, P2&& p2)
+template<class T>
+void swap(maybe_safe_ptr<T>& a, maybe_safe_ptr<T>& b) noexcept
 {
-    return detail::t3::make_safe_impl<detail::specialization_tag, T, P0, P1, P2>::make_safe(std::forward<P0>(p0), std::forward<P1>(p1), std::forward<P2>(p2));
+    a.swap(b);
 }
 
-template<typename T, typename P0, typename P1, typename P2, typename P3>
-safe_ptr<T> make_safe(P0&& p0, P1&& p1, P2&& p2, P3&& p3)
+//
+// try_dynamic_pointer_cast
+//
+// Like dynamic_pointer_cast but reports failure with an empty maybe_safe_ptr
+// instead of throwing. A failed cast leaves an rvalue argument untouched.
+//
+
+template <class T, class U>
+maybe_safe_ptr<T> try_dynamic_pointer_cast(const safe_ptr<U>& p)
 {
-    return detail::t4::make_safe_impl<detail::specialization_tag, T, P0, P1, P2, P3>::make_safe(std::forward<P0>(p0), std::forward<P1>(p1), std::forward<P2>(p2), std::forward<P3>(p3));
+    SPL_INSTRUMENT_COUNT(T, casts);
+    T* t = dynamic_cast<T*>(p.get());
+    if(!t)
+        return maybe_safe_ptr<T>();
+    return detail::safe_ptr_access::alias(p, t);
 }
 
-template<typename T, typename P0, typename P1, typename P2, typename P3, typename P4>
-safe_ptr<T> make_safe(P0&& p0, P1&& p1, P2&& p2, P3&& p3, P4&& p4)
+template <class T, class U>
+maybe_safe_ptr<T> try_dynamic_pointer_cast(safe_ptr<U>&& p)
 {
-    return detail::t5::make_safe_impl<detail::specialization_tag, T, P0, P1, P2, P3, P4>::make_safe(std::forward<P0>(p0), std::forward<P1>(p1), std::forward<P2>(p2), std::forward<P3>(p3), std::forward<P4>(p4));
+    SPL_INSTRUMENT_COUNT(T, casts);
+    T* t = dynamic_cast<T*>(p.get());
+    if(!t)
+        return maybe_safe_ptr<T>();
+    return detail::safe_ptr_access::alias(std::move(p), t);
 }
 
-#endif
+//
+// weak_safe_ptr
+//
+// A non-owning observer of an object owned by safe_ptrs, for caches and
+// observer lists. lock() returns a maybe_safe_ptr that is empty once the
+// object is gone; it is one compare-and-swap on the reference count, and
+// neither checks for null twice nor throws. A default constructed
+// weak_safe_ptr is expired.
+//
 
 template<typename T>
-safe_ptr<T>::safe_ptr()
-    : p_(make_safe<T>())
+class weak_safe_ptr
 {
-}
+    template <typename> friend class weak_safe_ptr;
+public:
+    typedef T  element_type;
 
-} // namespace
+    weak_safe_ptr() noexcept
+    {
+    }
+
+    template<typename U>
+    weak_safe_ptr(const safe_ptr<U>& p, typename std::enable_if<std::is_convertible<U*, T*>::value, void*>::type = 0) noexcept
+        : p_(detail::safe_ptr_access::shared(p))
+    {
+        SPL_INSTRUMENT_COUNT(T, weak_conversions);
+    }
+
+    template<typename U>
+    weak_safe_ptr(const weak_safe_ptr<U>& other, typename std::enable_if<std::is_convertible<U*, T*>::value, void*>::type = 0) noexcept
+        : p_(other.p_)
+    {
+    }
+
+    template<typename U>
+    weak_safe_ptr(weak_safe_ptr<U>&& other, typename std::enable_if<std::is_convertible<U*, T*>::value, void*>::type = 0) noexcept
+        : p_(std::move(other.p_))
+    {
+    }
+
+    template<typename U>
+    typename std::enable_if<std::is_convertible<U*, T*>::value, weak_safe_ptr&>::type
+    operator=(const safe_ptr<U>& p) noexcept
+    {
+        SPL_INSTRUMENT_COUNT(T, weak_conversions);
+        p_ = detail::safe_ptr_access::shared(p);
+        return *this;
+    }
+
+    maybe_safe_ptr<T> lock() const noexcept
+    {
+        return maybe_safe_ptr<T>(p_.lock());
+    }
+
+    bool expired() const noexcept
+    {
+        return p_.expired();
+    }
+
+    long use_count() const noexcept
+    {
+        return p_.use_count();
+    }
+
+    void reset() noexcept
+    {
+        p_.reset();
+    }
+
+    void swap(weak_safe_ptr& other) noexcept
+    {
+        p_.swap(other.p_);
+    }
+
+    template<class U>
+    bool owner_before(const weak_safe_ptr<U>& other) const noexcept
+    {
+        return p_.owner_before(other.p_);
+    }
+
+    template<class U>
+    bool owner_before(const safe_ptr<U>& other) const noexcept
+    {
+        return p_.owner_before(detail::safe_ptr_access::shared(other));
+    }
+
+    operator std::weak_ptr<T>() const noexcept
+    {
+        return p_;
+    }
+
+private:
+    std::weak_ptr<T> p_;
+};
+
+template<class T>
+void swap(weak_safe_ptr<T>& a, weak_safe_ptr<T>& b) noexcept
+{
+    a.swap(b);
+}
+
+//
+// erase_expired, for_each_alive
+//
+// Sweeps over a sequence container of weak_safe_ptrs such as a
+// std::vector or std::list. erase_expired removes the expired ones.
+// for_each_alive also calls f(T&) on every live object, holding it alive
+// for the call, and removes the expired ones in the same pass. Both keep
+// the order of the remaining elements and return how many were removed.
+//
+
+template<class Container>
+std::size_t erase_expired(Container& c)
+{
+    typename Container::iterator out = c.begin();
+    for (typename Container::iterator in = c.begin(); in != c.end(); ++in)
+    {
+        if (in->expired())
+            continue;
+        if (out != in)
+            *out = std::move(*in);
+        ++out;
+    }
+    std::size_t removed = static_cast<std::size_t>(std::distance(out, c.end()));
+    c.erase(out, c.end());
+    return removed;
+}
+
+template<class Container, class F>
+std::size_t for_each_alive(Container& c, F f)
+{
+    typename Container::iterator out = c.begin();
+    for (typename Container::iterator in = c.begin(); in != c.end(); ++in)
+    {
+        maybe_safe_ptr<typename Container::value_type::element_type> p = in->lock();
+        if (!p)
+            continue;
+        f(*p);
+        if (out != in)
+            *out = std::move(*in);
+        ++out;
+    }
+    std::size_t removed = static_cast<std::size_t>(std::distance(out, c.end()));
+    c.erase(out, c.end());
+    return removed;
+}
+
+//
+// enable_safe_this
+//
+// A safe_ptr version of enable_shared_from_this.
+// So that an object may get safe_ptr objects to itself.
+//
+
+template<class T>
+class enable_safe_from_this : public std::enable_shared_from_this<T>
+{
+public:
+    safe_ptr<T> safe_from_this()
+    {
+        return safe_ptr<T>(this->shared_from_this());
+    }
+
+    safe_ptr<T const> safe_from_this() const
+    {
+        return safe_ptr<T const>(this->shared_from_this());
+    }
+protected:
+    enable_safe_from_this()
+    {
+    }
+
+    enable_safe_from_this(const enable_safe_from_this&)
+    {
+    }
+
+    enable_safe_from_this& operator=(const enable_safe_from_this&)
+    {
+        return *this;
+    }
+
+    ~enable_safe_from_this ()
+    {
+    }
+};
+
+//
+// safe_ref
+//
+// A borrowed non-null pointer for passing an object down a call chain
+// without touching its reference count, in place of const safe_ptr<T>&. It
+// is one word wide and trivially copyable, and it owns nothing: whoever
+// creates a safe_ref must keep the object alive while it is in use.
+//
+// When T derives from enable_safe_from_this, promote() turns a safe_ref back
+// into an owning safe_ptr.
+//
+// Defining SPL_SAFE_REF_DEBUG makes a safe_ref made from a safe_ptr remember
+// a weak_ptr to the owner and assert on access that the owner is alive. This
+// changes the layout of safe_ref, so it must be defined the same way in every
+// translation unit.
+//
+
+template<typename T>
+class safe_ref
+{
+    template <typename> friend class safe_ref;
+public:
+    typedef T  element_type;
+
+    template<typename U>
+    safe_ref(const safe_ptr<U>& p, typename std::enable_if<std::is_convertible<U*, T*>::value, void*>::type = 0) noexcept
+        : p_(p.get())
+#ifdef SPL_SAFE_REF_DEBUG
+        , owner_(std::shared_ptr<const void>(std::shared_ptr<U>(p))), tracked_(p.use_count() != 0)
+#endif
+    {
+    }
+
+    // A safe_ref to a temporary safe_ptr would outlive the object.
+    template<typename U>
+    safe_ref(safe_ptr<U>&& p, typename std::enable_if<std::is_convertible<U*, T*>::value, void*>::type = 0) = delete;
+
+    template<typename U>
+    safe_ref(const safe_ref<U>& other, typename std::enable_if<std::is_convertible<U*, T*>::value, void*>::type = 0) noexcept
+        : p_(other.p_)
+#ifdef SPL_SAFE_REF_DEBUG
+        , owner_(other.owner_), tracked_(other.tracked_)
+#endif
+    {
+    }
+
+    template<typename U>
+    explicit safe_ref(U& r, typename std::enable_if<std::is_convertible<U*, T*>::value, void*>::type = 0) noexcept
+        : p_(std::addressof(r))
+#ifdef SPL_SAFE_REF_DEBUG
+        , tracked_(false)
+#endif
+    {
+    }
+
+    T& operator*() const
+    {
+        return *get();
+    }
+
+    T* operator->() const
+    {
+        return get();
+    }
+
+    T* get() const
+    {
+#ifdef SPL_SAFE_REF_DEBUG
+        assert((!tracked_ || !owner_.expired()) && "use of safe_ref after its owner died");
+#endif
+        return p_;
+    }
+
+    // Only for T derived from enable_safe_from_this and owned by a safe_ptr.
+    safe_ptr<T> promote() const
+    {
+        return static_pointer_cast<T>(get()->safe_from_this());
+    }
+
+private:
+    T* p_;
+#ifdef SPL_SAFE_REF_DEBUG
+    std::weak_ptr<const void> owner_;
+    bool tracked_;
+#endif
+};
+
+template<class T, class U>
+bool operator==(const safe_ref<T>& a, const safe_ref<U>& b)
+{
+    return a.get() == b.get();
+}
+
+template<class T, class U>
+bool operator==(const safe_ptr<T>& a, const safe_ref<U>& b)
+{
+    return a.get() == b.get();
+}
+
+template<class T, class U>
+bool operator==(const safe_ref<T>& a, const safe_ptr<U>& b)
+{
+    return a.get() == b.get();
+}
+
+template<class T, class U>
+bool operator!=(const safe_ref<T>& a, const safe_ref<U>& b)
+{
+    return a.get() != b.get();
+}
+
+template<class T, class U>
+bool operator!=(const safe_ptr<T>& a, const safe_ref<U>& b)
+{
+    return a.get() != b.get();
+}
+
+template<class T, class U>
+bool operator!=(const safe_ref<T>& a, const safe_ptr<U>& b)
+{
+    return a.get() != b.get();
+}
+
+template<class T, class U>
+bool operator<(const safe_ref<T>& a, const safe_ref<U>& b)
+{
+    return a.get() < b.get();
+}
+
+template<class T, class U>
+bool operator>(const safe_ref<T>& a, const safe_ref<U>& b)
+{
+    return a.get() > b.get();
+}
+
+template<class T, class U>
+bool operator>=(const safe_ref<T>& a, const safe_ref<U>& b)
+{
+    return a.get() >= b.get();
+}
+
+template<class T, class U>
+bool operator<=(const safe_ref<T>& a, const safe_ref<U>& b)
+{
+    return a.get() <= b.get();
+}
+
+template<class T>
+T* get_pointer(safe_ref<T> const& p)
+{
+    return p.get();
+}
+
+namespace detail
+{
+    // Mixes an address so that every bit of the result depends on every bit
+    // of the address. No bits are dropped: aliasing handles such as array
+    // elements, members and static_safe_ptr point at addresses with no
+    // particular alignment. The multiplication by an odd constant carries
+    // each bit upwards, and folding the high half back down makes the low
+    // bits, which pick the bucket, depend on the high ones.
+    inline std::size_t hash_address(const volatile void* p) noexcept
+    {
+        std::uint64_t x = reinterpret_cast<std::uintptr_t>(p);
+        x *= 0x9E3779B97F4A7C15ull;
+        x ^= x >> 32;
+        x *= 0xD6E8FEB86659FD93ull;
+        x ^= x >> 32;
+        return static_cast<std::size_t>(x);
+    }
+}
+
+//
+// ptr_hash, ptr_equal
+//
+// Hash and equality on the pointed-to address, for unordered containers
+// keyed by safe_ptr<T>. Both are transparent, so with C++20 heterogeneous
+// lookup a container can be searched by T*, safe_ref or shared_ptr without
+// building a temporary safe_ptr. Arguments are converted to T* first, so
+// pointers to different bases of one object compare and hash alike.
+//
+
+template<typename T>
+struct ptr_hash
+{
+    typedef void is_transparent;
+
+    std::size_t operator()(const T* p) const noexcept
+    {
+        return detail::hash_address(p);
+    }
+
+    template<typename U>
+    std::size_t operator()(const safe_ptr<U>& p) const noexcept
+    {
+        return (*this)(static_cast<const T*>(p.get()));
+    }
+
+    template<typename U>
+    std::size_t operator()(const safe_ref<U>& p) const noexcept
+    {
+        return (*this)(static_cast<const T*>(p.get()));
+    }
+
+    template<typename U>
+    std::size_t operator()(const std::shared_ptr<U>& p) const noexcept
+    {
+        return (*this)(static_cast<const T*>(p.get()));
+    }
+};
+
+template<typename T>
+struct ptr_equal
+{
+    typedef void is_transparent;
+
+    template<typename A, typename B>
+    bool operator()(const A& a, const B& b) const noexcept
+    {
+        return address(a) == address(b);
+    }
+
+private:
+    static const T* address(const T* p) noexcept
+    {
+        return p;
+    }
+
+    template<typename U>
+    static const T* address(const safe_ptr<U>& p) noexcept
+    {
+        return p.get();
+    }
+
+    template<typename U>
+    static const T* address(const safe_ref<U>& p) noexcept
+    {
+        return p.get();
+    }
+
+    template<typename U>
+    static const T* address(const std::shared_ptr<U>& p) noexcept
+    {
+        return p.get();
+    }
+};
+
+//
+// owner_less, owner_equal, owner_hash
+//
+// Ownership-based ordering and equality across safe_ptr, std::shared_ptr and
+// std::weak_ptr, as in std::owner_less. owner_hash needs the standard
+// library's owner_hash (C++26) and is only defined where it is available.
+//
+
+namespace detail
+{
+    template<typename T>
+    const std::shared_ptr<T>& owner_of(const std::shared_ptr<T>& p) noexcept
+    {
+        return p;
+    }
+
+    template<typename T>
+    const std::weak_ptr<T>& owner_of(const std::weak_ptr<T>& p) noexcept
+    {
+        return p;
+    }
+
+    template<typename T>
+    const std::shared_ptr<T>& owner_of(const safe_ptr<T>& p) noexcept
+    {
+        return safe_ptr_access::shared(p);
+    }
+
+    template<typename T>
+    std::weak_ptr<T> owner_of(const weak_safe_ptr<T>& p) noexcept
+    {
+        return p;
+    }
+}
+
+struct owner_less
+{
+    typedef void is_transparent;
+
+    template<typename A, typename B>
+    bool operator()(const A& a, const B& b) const noexcept
+    {
+        return detail::owner_of(a).owner_before(detail::owner_of(b));
+    }
+};
+
+struct owner_equal
+{
+    typedef void is_transparent;
+
+    template<typename A, typename B>
+    bool operator()(const A& a, const B& b) const noexcept
+    {
+        return !detail::owner_of(a).owner_before(detail::owner_of(b))
+            && !detail::owner_of(b).owner_before(detail::owner_of(a));
+    }
+};
+
+#ifdef __cpp_lib_smart_ptr_owner_equality
+struct owner_hash
+{
+    typedef void is_transparent;
+
+    template<typename P>
+    std::size_t operator()(const P& p) const noexcept
+    {
+        return detail::owner_of(p).owner_hash();
+    }
+};
+#endif
+
+//
+// is_trivially_relocatable
+//
+// True for types whose objects can be moved to new storage by copying their
+// bytes, after which the old storage is released without running the
+// destructor. Containers such as safe_ptr_vector use it to grow, insert and
+// erase with memcpy and memmove instead of moving element by element.
+//
+// safe_ptr and maybe_safe_ptr hold nothing but a std::shared_ptr, which is a
+// pair of pointers that nothing else points into. Specialize it for other
+// types that are known to qualify.
+//
+
+template<typename T>
+struct is_trivially_relocatable
+    : std::integral_constant<bool, std::is_trivially_copyable<T>::value>
+{
+};
+
+template<typename T>
+struct is_trivially_relocatable<safe_ptr<T> > : std::true_type
+{
+};
+
+template<typename T>
+struct is_trivially_relocatable<maybe_safe_ptr<T> > : std::true_type
+{
+};
+
+namespace detail
+{
+    template<typename T>
+    T && forward_type();
+
+    template<typename... Ts>
+    struct make_void
+    {
+        typedef void type;
+    };
+
+    template<typename R>
+    struct check_make_safe_result : std::true_type
+    {
+        static_assert( std::is_same<R, safe_ptr<typename R::element_type> >::value, "make_safe should return a safe_ptr" );
+    };
+
+    //
+    // has_make_safe<T, Args...> is true when T::make_safe can be called with
+    // Args. It is worked out once per T and argument pack; make_safe,
+    // allocate_safe and the other factories then only pick a branch.
+    //
+#ifdef __cpp_concepts
+    template<typename T, typename... Args>
+    struct has_make_safe : std::false_type
+    {
+    };
+
+    template<typename T, typename... Args>
+        requires requires { T::make_safe(forward_type<Args>()...); }
+    struct has_make_safe<T, Args...> : check_make_safe_result<decltype(T::make_safe(forward_type<Args>()...))>
+    {
+    };
+#else
+    template<typename Void, typename T, typename... Args>
+    struct has_make_safe_impl : std::false_type
+    {
+    };
+
+    template<typename T, typename... Args>
+    struct has_make_safe_impl<typename make_void<decltype(T::make_safe(forward_type<Args>()...))>::type, T, Args...>
+        : check_make_safe_result<decltype(T::make_safe(forward_type<Args>()...))>
+    {
+    };
+
+    template<typename T, typename... Args>
+    struct has_make_safe : has_make_safe_impl<void, T, Args...>
+    {
+    };
+#endif
+
+    template<typename Void, typename T, typename Alloc, typename... Args>
+    struct has_allocate_safe_impl : std::false_type
+    {
+    };
+
+    template<typename T, typename Alloc, typename... Args>
+    struct has_allocate_safe_impl<typename make_void<decltype(T::allocate_safe(forward_type<const Alloc&>(), forward_type<Args>()...))>::type, T, Alloc, Args...>
+        : check_make_safe_result<decltype(T::allocate_safe(forward_type<const Alloc&>(), forward_type<Args>()...))>
+    {
+    };
+
+    template<typename T, typename Alloc, typename... Args>
+    struct has_allocate_safe : has_allocate_safe_impl<void, T, Alloc, Args...>
+    {
+    };
+
+#ifndef __cpp_if_constexpr
+    // T::make_safe exists
+    template<typename T, typename... Args>
+    safe_ptr<T> make_safe(std::true_type, Args&&... args)
+    {
+        return T::make_safe(std::forward<Args>(args)...);
+    }
+
+    template<typename T, typename... Args>
+    safe_ptr<T> make_safe(std::false_type, Args&&... args)
+    {
+        SPL_INSTRUMENT_COUNT(T, allocations);
+        return safe_ptr_access::adopt(std::make_shared<T>(std::forward<Args>(args)...));
+    }
+
+    // T::allocate_safe exists
+    template<typename T, typename Alloc, typename... Args>
+    safe_ptr<T> allocate_safe(std::true_type, std::false_type, const Alloc& alloc, Args&&... args)
+    {
+        return T::allocate_safe(alloc, std::forward<Args>(args)...);
+    }
+
+    // T::make_safe exists, so T controls its own construction
+    template<typename T, typename Alloc, typename... Args>
+    safe_ptr<T> allocate_safe(std::false_type, std::true_type, const Alloc&, Args&&... args)
+    {
+        return T::make_safe(std::forward<Args>(args)...);
+    }
+
+    template<typename T, typename Alloc, typename... Args>
+    safe_ptr<T> allocate_safe(std::false_type, std::false_type, const Alloc& alloc, Args&&... args)
+    {
+        SPL_INSTRUMENT_COUNT(T, allocations);
+        return safe_ptr_access::adopt(std::allocate_shared<T>(alloc, std::forward<Args>(args)...));
+    }
+#endif
+
+} // namespace detail
+
+//
+// make_safe
+//
+// safe_ptr equivalents to make_shared. A class can take over construction
+// with a static T::make_safe(args...).
+//
+
+// Variadic templates are always available now; kept for code that tests it.
+#ifndef SPL_HAS_VARIADIC_TEMPLATES
+#define SPL_HAS_VARIADIC_TEMPLATES
+#endif
+
+template<typename T, typename... Args>
+safe_ptr<T> make_safe(Args&&... args)
+{
+#ifdef __cpp_if_constexpr
+    if constexpr (detail::has_make_safe<T, Args...>::value)
+        return T::make_safe(std::forward<Args>(args)...);
+    else
+    {
+        SPL_INSTRUMENT_COUNT(T, allocations);
+        return detail::safe_ptr_access::adopt(std::make_shared<T>(std::forward<Args>(args)...));
+    }
+#else
+    return detail::make_safe<T>(detail::has_make_safe<T, Args...>(), std::forward<Args>(args)...);
+#endif
+}
+
+//
+// allocate_safe
+//
+// safe_ptr equivalent to allocate_shared. A class can take over allocation
+// with a static T::allocate_safe(alloc, args...). A class that only provides
+// T::make_safe keeps control of its construction, and the allocator is not
+// used.
+//
+
+template<typename T, typename Alloc, typename... Args>
+safe_ptr<T> allocate_safe(const Alloc& alloc, Args&&... args)
+{
+#ifdef __cpp_if_constexpr
+    if constexpr (detail::has_allocate_safe<T, Alloc, Args...>::value)
+        return T::allocate_safe(alloc, std::forward<Args>(args)...);
+    else if constexpr (detail::has_make_safe<T, Args...>::value)
+        return T::make_safe(std::forward<Args>(args)...);
+    else
+    {
+        SPL_INSTRUMENT_COUNT(T, allocations);
+        return detail::safe_ptr_access::adopt(std::allocate_shared<T>(alloc, std::forward<Args>(args)...));
+    }
+#else
+    return detail::allocate_safe<T>(detail::has_allocate_safe<T, Alloc, Args...>(),
+        std::integral_constant<bool, !detail::has_allocate_safe<T, Alloc, Args...>::value && detail::has_make_safe<T, Args...>::value>(),
+        alloc, std::forward<Args>(args)...);
+#endif
+}
+
+#ifdef SPL_HAS_MEMORY_RESOURCE
+
+namespace pmr
+{
+    // Allocates the object and its control block from resource. Every
+    // safe_ptr to the object must be gone before resource is released, as
+    // with any other allocation from it.
+    template<typename T, typename... Args>
+    safe_ptr<T> allocate_safe(std::pmr::memory_resource* resource, Args&&... args)
+    {
+        return spl::allocate_safe<T>(std::pmr::polymorphic_allocator<T>(resource), std::forward<Args>(args)...);
+    }
+}
+
+#endif
+
+//
+// share_default_instance
+//
+// Specialize as std::true_type for a T whose default constructed
+// safe_ptr<const T>s should all point to one shared instance instead of each
+// allocating a new T, e.g. one whose safe_ptr members are always assigned
+// right after construction. Only safe_ptr<const T> shares it, since a change
+// through one safe_ptr would show through all the others; a default
+// constructed safe_ptr<T> still gets a new T. The instance is made with
+// make_safe<T>() on first use and never destroyed, and copies of it are
+// static_safe_ptrs: they touch no reference count, use_count() is 0 and
+// weak_safe_ptrs made from them are always expired. A T::make_safe() hook
+// that returns a shared instance of its own works too, but pays for a
+// reference count increment per default constructed safe_ptr.
+//
+
+template<typename T>
+struct share_default_instance : std::false_type
+{
+};
+
+template<typename T>
+safe_ptr<T> default_instance()
+{
+    static_assert(std::is_const<T>::value, "default_instance: only safe_ptr<const T> shares the default instance");
+    static const safe_ptr<T>* instance = new safe_ptr<T>(make_safe<typename std::remove_cv<T>::type>());
+    return static_safe_ptr(**instance);
+}
+
+namespace detail
+{
+    template<typename T>
+    struct shares_default_instance
+        : std::integral_constant<bool, std::is_const<T>::value &&
+                                       share_default_instance<typename std::remove_cv<T>::type>::value>
+    {
+    };
+
+    template<typename T>
+    safe_ptr<T> default_construct(std::true_type)
+    {
+        return default_instance<T>();
+    }
+
+    template<typename T>
+    safe_ptr<T> default_construct(std::false_type)
+    {
+        return spl::make_safe<T>();
+    }
+}
+
+template<typename T>
+safe_ptr<T>::safe_ptr()
+    : p_(detail::default_construct<T>(detail::shares_default_instance<T>()))
+{
+}
+
+} // namespace
+
+namespace std
+{
+
+template<typename T>
+struct hash<spl::safe_ptr<T> >
+{
+    std::size_t operator()(const spl::safe_ptr<T>& p) const noexcept
+    {
+        return spl::detail::hash_address(p.get());
+    }
+};
+
+template<typename T>
+struct hash<spl::safe_ref<T> >
+{
+    std::size_t operator()(const spl::safe_ref<T>& p) const noexcept
+    {
+        return spl::detail::hash_address(p.get());
+    }
+};
 
+} // namespace std
@@ -0,0 +1,430 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <type_traits>
+#include <typeinfo>
+#include <vector>
+
+#ifdef __GNUG__
+#include <cstdlib>
+#include <cxxabi.h>
+#endif
+
+//
+// safe_ptr instrumentation
+//
+// Define SPL_SAFE_PTR_INSTRUMENT to count what safe_ptrs do: copies, moves,
+// casts, conversions to std::shared_ptr and std::weak_ptr, make_safe and
+// allocate_safe calls, and null pointers rejected with std::invalid_argument.
+// Counts are kept per element type and per call site, where a call site is
+// the innermost SPL_INSTRUMENT_SCOPE on the calling thread.
+//
+// The macro must be defined the same way in every translation unit of a
+// program. Without it the hooks expand to nothing, and snapshots are empty.
+//
+// Each thread counts into its own block with plain loads and stores, so
+// counting adds no locked instructions and no cache line sharing. A
+// snapshot reads every thread's block under a mutex without stopping them,
+// and can be taken at any time, e.g. from a diagnostics endpoint. Counts of
+// exited threads are kept.
+//
+// Only the first SPL_INSTRUMENT_MAX_TYPES element types get their own
+// counters; the rest are reported as "(other)". Operations outside any scope,
+// and in scopes past the first SPL_INSTRUMENT_MAX_SITES, are reported under
+// the site "(none)".
+//
+
+#ifndef SPL_INSTRUMENT_MAX_TYPES
+#define SPL_INSTRUMENT_MAX_TYPES 64
+#endif
+
+#ifndef SPL_INSTRUMENT_MAX_SITES
+#define SPL_INSTRUMENT_MAX_SITES 32
+#endif
+
+namespace spl
+{
+
+namespace instrument
+{
+
+enum event
+{
+    copies,
+    moves,
+    casts,
+    shared_conversions,
+    weak_conversions,
+    allocations,
+    null_throws,
+    event_count
+};
+
+inline const char* event_name(event e)
+{
+    static const char* const names[event_count] =
+    {
+        "copy", "move", "cast", "to_shared", "to_weak", "make_safe", "null_throw"
+    };
+    return names[e];
+}
+
+typedef std::array<unsigned long long, event_count> event_counts;
+
+// Counts by element type name and by call site name.
+struct snapshot
+{
+    std::map<std::string, event_counts> types;
+    std::map<std::string, event_counts> sites;
+};
+
+namespace detail
+{
+    inline void write_field(std::ostream& out, const std::string& s)
+    {
+        if (s.find_first_of(",\"") == std::string::npos)
+        {
+            out << s;
+            return;
+        }
+        out << '"';
+        for (std::size_t i = 0; i < s.size(); ++i)
+        {
+            if (s[i] == '"')
+                out << '"';
+            out << s[i];
+        }
+        out << '"';
+    }
+
+    inline void write_rows(std::ostream& out, const char* kind, const std::map<std::string, event_counts>& rows)
+    {
+        for (std::map<std::string, event_counts>::const_iterator i = rows.begin(); i != rows.end(); ++i)
+        {
+            for (int e = 0; e < event_count; ++e)
+            {
+                if (!i->second[e])
+                    continue;
+                out << kind << ',';
+                write_field(out, i->first);
+                out << ',' << event_name(event(e)) << ',' << i->second[e] << '\n';
+            }
+        }
+    }
+}
+
+// Writes s as CSV lines kind,name,event,count, where kind is type or site.
+// Zero counts are left out.
+inline void dump(std::ostream& out, const snapshot& s)
+{
+    out << "kind,name,event,count\n";
+    detail::write_rows(out, "type", s.types);
+    detail::write_rows(out, "site", s.sites);
+}
+
+namespace detail
+{
+    inline std::string demangle(const char* name)
+    {
+    #ifdef __GNUG__
+        int status = 0;
+        char* readable = abi::__cxa_demangle(name, 0, 0, &status);
+        if (status == 0 && readable)
+        {
+            std::string result(readable);
+            std::free(readable);
+            return result;
+        }
+    #endif
+        return name;
+    }
+}
+
+// Name under which counts for element type T are reported.
+template<typename T>
+std::string type_name()
+{
+    return detail::demangle(typeid(typename std::remove_cv<T>::type).name());
+}
+
+#ifdef SPL_SAFE_PTR_INSTRUMENT
+
+namespace detail
+{
+    typedef std::atomic<unsigned long long> counter;
+
+    // Written only by the owning thread, read by snapshots.
+    struct thread_counters
+    {
+        counter by_type[SPL_INSTRUMENT_MAX_TYPES][event_count];
+        counter by_site[SPL_INSTRUMENT_MAX_SITES][event_count];
+        unsigned site;
+
+        thread_counters()
+            : site(0)
+        {
+            for (int t = 0; t < SPL_INSTRUMENT_MAX_TYPES; ++t)
+                for (int e = 0; e < event_count; ++e)
+                    by_type[t][e].store(0, std::memory_order_relaxed);
+            for (int s = 0; s < SPL_INSTRUMENT_MAX_SITES; ++s)
+                for (int e = 0; e < event_count; ++e)
+                    by_site[s][e].store(0, std::memory_order_relaxed);
+        }
+    };
+
+    inline void bump(counter& c)
+    {
+        c.store(c.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    struct registry
+    {
+        std::mutex mutex;
+        std::vector<thread_counters*> live;
+        thread_counters exited;
+        std::vector<std::string> types;
+        std::vector<std::string> sites;
+
+        registry()
+        {
+            types.push_back("(other)");
+            sites.push_back("(none)");
+        }
+    };
+
+    // Never destroyed, so threads that exit after main returns can still
+    // hand in their counts.
+    inline registry& global()
+    {
+        static registry* r = new registry;
+        return *r;
+    }
+
+    inline unsigned register_name(std::vector<std::string>& names, std::size_t max, const std::string& name)
+    {
+        registry& r = global();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        for (std::size_t i = 1; i < names.size(); ++i)
+            if (names[i] == name)
+                return static_cast<unsigned>(i);
+        if (names.size() >= max)
+            return 0;
+        names.push_back(name);
+        return static_cast<unsigned>(names.size() - 1);
+    }
+
+    template<typename T>
+    unsigned type_index()
+    {
+        static const unsigned index = register_name(global().types, SPL_INSTRUMENT_MAX_TYPES, demangle(typeid(T).name()));
+        return index;
+    }
+
+    // Trivially destructible, so still usable while the thread's other
+    // thread_local objects are being destroyed.
+    struct thread_state
+    {
+        static thread_counters*& current()
+        {
+            static thread_local thread_counters* c = 0;
+            return c;
+        }
+
+        static bool& exiting()
+        {
+            static thread_local bool e = false;
+            return e;
+        }
+    };
+
+    // The calling thread's counters, or null once the thread is exiting.
+    inline thread_counters* local_counters()
+    {
+        struct holder
+        {
+            thread_counters* counters;
+
+            holder()
+                : counters(new thread_counters)
+            {
+                registry& r = global();
+                std::lock_guard<std::mutex> lock(r.mutex);
+                r.live.push_back(counters);
+            }
+
+            ~holder()
+            {
+                thread_state::current() = 0;
+                thread_state::exiting() = true;
+
+                registry& r = global();
+                std::lock_guard<std::mutex> lock(r.mutex);
+                for (int t = 0; t < SPL_INSTRUMENT_MAX_TYPES; ++t)
+                    for (int e = 0; e < event_count; ++e)
+                        r.exited.by_type[t][e] += counters->by_type[t][e].load(std::memory_order_relaxed);
+                for (int s = 0; s < SPL_INSTRUMENT_MAX_SITES; ++s)
+                    for (int e = 0; e < event_count; ++e)
+                        r.exited.by_site[s][e] += counters->by_site[s][e].load(std::memory_order_relaxed);
+                for (std::size_t i = 0; i < r.live.size(); ++i)
+                {
+                    if (r.live[i] == counters)
+                    {
+                        r.live.erase(r.live.begin() + i);
+                        break;
+                    }
+                }
+                delete counters;
+            }
+        };
+
+        thread_counters* c = thread_state::current();
+        if (!c && !thread_state::exiting())
+        {
+            static thread_local holder h;
+            c = thread_state::current() = h.counters;
+        }
+        return c;
+    }
+
+    // Adds the counters of c to s. Called with the registry locked.
+    inline void collect(const registry& r, const thread_counters& c, snapshot& s)
+    {
+        for (std::size_t t = 0; t < r.types.size(); ++t)
+        {
+            event_counts& row = s.types[r.types[t]];
+            for (int e = 0; e < event_count; ++e)
+                row[e] += c.by_type[t][e].load(std::memory_order_relaxed);
+        }
+        for (std::size_t i = 0; i < r.sites.size(); ++i)
+        {
+            event_counts& row = s.sites[r.sites[i]];
+            for (int e = 0; e < event_count; ++e)
+                row[e] += c.by_site[i][e].load(std::memory_order_relaxed);
+        }
+    }
+
+    inline void clear(const registry& r, snapshot& s)
+    {
+        event_counts zero = event_counts();
+        for (std::size_t t = 0; t < r.types.size(); ++t)
+            s.types[r.types[t]] = zero;
+        for (std::size_t i = 0; i < r.sites.size(); ++i)
+            s.sites[r.sites[i]] = zero;
+    }
+
+} // namespace detail
+
+template<typename T>
+void count(event e)
+{
+    if (detail::thread_counters* c = detail::local_counters())
+    {
+        detail::bump(c->by_type[detail::type_index<typename std::remove_cv<T>::type>()][e]);
+        detail::bump(c->by_site[c->site][e]);
+    }
+}
+
+inline unsigned register_site(const char* name)
+{
+    return detail::register_name(detail::global().sites, SPL_INSTRUMENT_MAX_SITES, name);
+}
+
+// Attributes the calling thread's counts to a site until destroyed. Use
+// through SPL_INSTRUMENT_SCOPE.
+class site_scope
+{
+public:
+    explicit site_scope(unsigned site)
+        : counters_(detail::local_counters()), previous_(0)
+    {
+        if (counters_)
+        {
+            previous_ = counters_->site;
+            counters_->site = site;
+        }
+    }
+
+    ~site_scope()
+    {
+        if (counters_ && detail::thread_state::current() == counters_)
+            counters_->site = previous_;
+    }
+
+private:
+    site_scope(const site_scope&);
+    site_scope& operator=(const site_scope&);
+
+    detail::thread_counters* counters_;
+    unsigned previous_;
+};
+
+// Counts of every thread, including exited ones.
+inline snapshot take_snapshot()
+{
+    detail::registry& r = detail::global();
+    snapshot s;
+    std::lock_guard<std::mutex> lock(r.mutex);
+    detail::clear(r, s);
+    detail::collect(r, r.exited, s);
+    for (std::size_t i = 0; i < r.live.size(); ++i)
+        detail::collect(r, *r.live[i], s);
+    return s;
+}
+
+// Counts of the calling thread only.
+inline snapshot take_thread_snapshot()
+{
+    detail::registry& r = detail::global();
+    snapshot s;
+    detail::thread_counters* c = detail::local_counters();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    detail::clear(r, s);
+    if (c)
+        detail::collect(r, *c, s);
+    return s;
+}
+
+} // namespace instrument
+
+} // namespace
+
+#define SPL_INSTRUMENT_CONCAT2(a, b) a##b
+#define SPL_INSTRUMENT_CONCAT(a, b) SPL_INSTRUMENT_CONCAT2(a, b)
+
+#define SPL_INSTRUMENT_COUNT(T, e) ::spl::instrument::count<T>(::spl::instrument::e)
+
+// Attributes safe_ptr operations on this thread to name until the end of the
+// enclosing block. name must be a string literal or otherwise outlive the
+// program's use of it.
+#define SPL_INSTRUMENT_SCOPE(name) \
+    static const unsigned SPL_INSTRUMENT_CONCAT(spl_instrument_site_, __LINE__) = ::spl::instrument::register_site(name); \
+    ::spl::instrument::site_scope SPL_INSTRUMENT_CONCAT(spl_instrument_scope_, __LINE__)(SPL_INSTRUMENT_CONCAT(spl_instrument_site_, __LINE__))
+
+#else // SPL_SAFE_PTR_INSTRUMENT
+
+inline snapshot take_snapshot()
+{
+    return snapshot();
+}
+
+inline snapshot take_thread_snapshot()
+{
+    return snapshot();
+}
+
+} // namespace instrument
+
+} // namespace
+
+#ifndef SPL_INSTRUMENT_COUNT
+#define SPL_INSTRUMENT_COUNT(T, e) ((void)0)
+#endif
+
+#define SPL_INSTRUMENT_SCOPE(name) ((void)0)
+
+#endif // SPL_SAFE_PTR_INSTRUMENT
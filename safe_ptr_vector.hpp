@@ -0,0 +1,358 @@
+#pragma once
+
+#include "safe_ptr.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <limits>
+#include <new>
+#include <stdexcept>
+#include <vector>
+
+namespace spl
+{
+
+//
+// safe_ptr_vector
+//
+// A sequence of safe_ptr<T> that never holds a moved-from element. It relies
+// on safe_ptr being trivially relocatable: growing, inserting, erasing,
+// sorting and partitioning move the elements with memcpy and memmove and
+// never touch their reference counts.
+//
+// Next to the safe_ptrs it keeps their raw pointers in a second contiguous
+// array, pointers(), so that scans over the objects read one word per
+// element instead of two.
+//
+// Elements are only handed out as const references, since a safe_ptr moved
+// out of the vector would leave a null slot. Use set() to replace one.
+//
+
+template<typename T>
+class safe_ptr_vector
+{
+    static_assert(is_trivially_relocatable<safe_ptr<T> >::value, "safe_ptr_vector relocates safe_ptrs with memcpy");
+public:
+    typedef safe_ptr<T> value_type;
+    typedef std::size_t size_type;
+    typedef const safe_ptr<T>& const_reference;
+    typedef const safe_ptr<T>* const_iterator;
+    typedef const safe_ptr<T>* iterator;
+
+    safe_ptr_vector() noexcept
+        : owners_(0), pointers_(0), size_(0), capacity_(0)
+    {
+    }
+
+    safe_ptr_vector(const safe_ptr_vector& other)
+        : owners_(0), pointers_(0), size_(0), capacity_(0)
+    {
+        reserve(other.size_);
+        for (size_type i = 0; i < other.size_; ++i)
+            ::new (static_cast<void*>(owners_ + i)) safe_ptr<T>(other.owners_[i]);
+        move_pointers(pointers_, other.pointers_, other.size_);
+        size_ = other.size_;
+    }
+
+    safe_ptr_vector(safe_ptr_vector&& other) noexcept
+        : owners_(other.owners_), pointers_(other.pointers_), size_(other.size_), capacity_(other.capacity_)
+    {
+        other.owners_ = 0;
+        other.pointers_ = 0;
+        other.size_ = 0;
+        other.capacity_ = 0;
+    }
+
+    ~safe_ptr_vector()
+    {
+        clear();
+        deallocate(owners_, pointers_);
+    }
+
+    safe_ptr_vector& operator=(const safe_ptr_vector& other)
+    {
+        safe_ptr_vector(other).swap(*this);
+        return *this;
+    }
+
+    safe_ptr_vector& operator=(safe_ptr_vector&& other) noexcept
+    {
+        safe_ptr_vector(std::move(other)).swap(*this);
+        return *this;
+    }
+
+    size_type size() const
+    {
+        return size_;
+    }
+
+    bool empty() const
+    {
+        return size_ == 0;
+    }
+
+    size_type capacity() const
+    {
+        return capacity_;
+    }
+
+    // Largest n for which both arrays of n elements fit in std::size_t bytes.
+    static size_type max_size()
+    {
+        return std::numeric_limits<size_type>::max() / sizeof(safe_ptr<T>);
+    }
+
+    const safe_ptr<T>& operator[](size_type i) const
+    {
+        assert(i < size_);
+        return owners_[i];
+    }
+
+    const safe_ptr<T>& at(size_type i) const
+    {
+        if (i >= size_)
+            throw std::out_of_range("i");
+        return owners_[i];
+    }
+
+    const safe_ptr<T>& front() const
+    {
+        return (*this)[0];
+    }
+
+    const safe_ptr<T>& back() const
+    {
+        return (*this)[size_ - 1];
+    }
+
+    const_iterator begin() const
+    {
+        return owners_;
+    }
+
+    const_iterator end() const
+    {
+        return owners_ + size_;
+    }
+
+    // pointers()[i] == (*this)[i].get() for every i < size()
+    T* const* pointers() const
+    {
+        return pointers_;
+    }
+
+    void reserve(size_type n)
+    {
+        if (n <= capacity_)
+            return;
+        if (n > max_size())
+            throw std::length_error("safe_ptr_vector");
+        safe_ptr<T>* owners = 0;
+        T** pointers = 0;
+        allocate(n, owners, pointers);
+        relocate(owners, owners_, size_);
+        move_pointers(pointers, pointers_, size_);
+        deallocate(owners_, pointers_);
+        owners_ = owners;
+        pointers_ = pointers;
+        capacity_ = n;
+    }
+
+    void push_back(safe_ptr<T> p)
+    {
+        grow_for(1);
+        pointers_[size_] = p.get();
+        ::new (static_cast<void*>(owners_ + size_)) safe_ptr<T>(std::move(p));
+        ++size_;
+    }
+
+    iterator insert(const_iterator pos, safe_ptr<T> p)
+    {
+        size_type i = index_of(pos);
+        grow_for(1);
+        relocate(owners_ + i + 1, owners_ + i, size_ - i);
+        move_pointers(pointers_ + i + 1, pointers_ + i, size_ - i);
+        pointers_[i] = p.get();
+        ::new (static_cast<void*>(owners_ + i)) safe_ptr<T>(std::move(p));
+        ++size_;
+        return owners_ + i;
+    }
+
+    iterator erase(const_iterator pos)
+    {
+        return erase(pos, pos + 1);
+    }
+
+    iterator erase(const_iterator first, const_iterator last)
+    {
+        size_type i = index_of(first);
+        size_type j = index_of(last);
+        assert(i <= j);
+        for (size_type k = i; k < j; ++k)
+            owners_[k].~safe_ptr<T>();
+        relocate(owners_ + i, owners_ + j, size_ - j);
+        move_pointers(pointers_ + i, pointers_ + j, size_ - j);
+        size_ -= j - i;
+        return owners_ + i;
+    }
+
+    void pop_back()
+    {
+        assert(size_ > 0);
+        owners_[--size_].~safe_ptr<T>();
+    }
+
+    void clear() noexcept
+    {
+        while (size_)
+            owners_[--size_].~safe_ptr<T>();
+    }
+
+    void set(size_type i, safe_ptr<T> p)
+    {
+        assert(i < size_);
+        pointers_[i] = p.get();
+        owners_[i] = std::move(p);
+    }
+
+    // Sorts by the objects, comparing them with comp(const T&, const T&).
+    // If comp throws the vector is left unchanged.
+    template<class Compare>
+    void sort(Compare comp)
+    {
+        std::vector<size_type> order(size_);
+        for (size_type i = 0; i < size_; ++i)
+            order[i] = i;
+        T* const* pointers = pointers_;
+        std::stable_sort(order.begin(), order.end(), [pointers, &comp](size_type a, size_type b) {
+            return comp(*pointers[a], *pointers[b]);
+        });
+        permute(order);
+    }
+
+    // Sorts by address, e.g. to look objects up with std::binary_search on
+    // pointers() afterwards.
+    void sort()
+    {
+        std::vector<size_type> order(size_);
+        for (size_type i = 0; i < size_; ++i)
+            order[i] = i;
+        T* const* pointers = pointers_;
+        std::sort(order.begin(), order.end(), [pointers](size_type a, size_type b) {
+            return std::less<T*>()(pointers[a], pointers[b]);
+        });
+        permute(order);
+    }
+
+    // Moves the elements whose objects satisfy pred(const T&) to the front,
+    // keeping the relative order on both sides, and returns how many there
+    // are. If pred throws the vector is left unchanged.
+    template<class Predicate>
+    size_type partition(Predicate pred)
+    {
+        std::vector<size_type> order;
+        order.reserve(size_);
+        std::vector<size_type> rest;
+        for (size_type i = 0; i < size_; ++i)
+        {
+            if (pred(*pointers_[i]))
+                order.push_back(i);
+            else
+                rest.push_back(i);
+        }
+        size_type matched = order.size();
+        order.insert(order.end(), rest.begin(), rest.end());
+        permute(order);
+        return matched;
+    }
+
+    void swap(safe_ptr_vector& other) noexcept
+    {
+        std::swap(owners_, other.owners_);
+        std::swap(pointers_, other.pointers_);
+        std::swap(size_, other.size_);
+        std::swap(capacity_, other.capacity_);
+    }
+
+private:
+    static void allocate(size_type n, safe_ptr<T>*& owners, T**& pointers)
+    {
+        if (n > max_size())
+            throw std::length_error("safe_ptr_vector");
+        owners = static_cast<safe_ptr<T>*>(::operator new(n * sizeof(safe_ptr<T>)));
+        try
+        {
+            pointers = static_cast<T**>(::operator new(n * sizeof(T*)));
+        }
+        catch (...)
+        {
+            ::operator delete(owners);
+            throw;
+        }
+    }
+
+    static void deallocate(safe_ptr<T>* owners, T** pointers)
+    {
+        ::operator delete(owners);
+        ::operator delete(pointers);
+    }
+
+    // Moves n safe_ptrs from from to to; the ranges may overlap. Afterwards
+    // the objects live at to and the storage at from is raw.
+    static void relocate(safe_ptr<T>* to, const safe_ptr<T>* from, size_type n)
+    {
+        if (n)
+            std::memmove(static_cast<void*>(to), static_cast<const void*>(from), n * sizeof(safe_ptr<T>));
+    }
+
+    static void move_pointers(T** to, T* const* from, size_type n)
+    {
+        if (n)
+            std::memmove(to, from, n * sizeof(T*));
+    }
+
+    size_type index_of(const_iterator pos) const
+    {
+        assert(pos >= owners_ && pos <= owners_ + size_);
+        return static_cast<size_type>(pos - owners_);
+    }
+
+    void grow_for(size_type extra)
+    {
+        if (size_ + extra > capacity_)
+        {
+            size_type doubled = capacity_ > max_size() / 2 ? max_size() : capacity_ * 2;
+            reserve(std::max(size_ + extra, capacity_ ? doubled : size_type(4)));
+        }
+    }
+
+    // Rearranges the elements so that element i is the old element order[i].
+    void permute(const std::vector<size_type>& order)
+    {
+        safe_ptr<T>* owners = 0;
+        T** pointers = 0;
+        allocate(capacity_, owners, pointers);
+        for (size_type i = 0; i < size_; ++i)
+        {
+            relocate(owners + i, owners_ + order[i], 1);
+            pointers[i] = pointers_[order[i]];
+        }
+        deallocate(owners_, pointers_);
+        owners_ = owners;
+        pointers_ = pointers;
+    }
+
+    safe_ptr<T>* owners_;
+    T** pointers_;
+    size_type size_;
+    size_type capacity_;
+};
+
+template<class T>
+void swap(safe_ptr_vector<T>& a, safe_ptr_vector<T>& b) noexcept
+{
+    a.swap(b);
+}
+
+} // namespace
@@ -0,0 +1,282 @@
+#pragma once
+
+#include "safe_ptr.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace spl
+{
+
+//
+// reclaim_stats
+//
+// Counters of a reclaim_queue.
+//
+
+struct reclaim_stats
+{
+    std::size_t depth;                  // objects waiting to be destroyed
+    std::size_t max_depth;              // highest depth seen
+    unsigned long long deferred;        // objects queued
+    unsigned long long reclaimed;       // objects destroyed by drain()
+    unsigned long long inline_reclaims; // objects destroyed on release because the queue was full or out of memory
+    unsigned long long batches;         // drain() calls that destroyed something
+    std::chrono::nanoseconds last_lag;  // age of the oldest object in the last batch
+    std::chrono::nanoseconds max_lag;   // highest last_lag seen
+};
+
+//
+// reclaim_queue
+//
+// Takes objects whose last owner has gone away and destroys them later, in
+// batches, on whichever thread calls drain(): a reclaim_thread, or the
+// application at a point where latency does not matter. Releasing the last
+// safe_ptr then costs a short critical section instead of the object's
+// destructor and everything it owns.
+//
+// Once capacity objects are waiting, further ones are destroyed on release,
+// so a stalled drainer cannot make memory grow without bound. So are those
+// that the queue runs out of memory to hold.
+//
+// The queue must outlive every object it may be handed; its destructor
+// destroys whatever is still waiting.
+//
+
+class reclaim_queue
+{
+public:
+    typedef std::chrono::steady_clock clock;
+
+    explicit reclaim_queue(std::size_t capacity = 65536, std::size_t batch_size = 256)
+        : capacity_(capacity), batch_size_(batch_size), woken_(false)
+    {
+        stats_ = reclaim_stats();
+    }
+
+    ~reclaim_queue()
+    {
+        while (drain())
+        {
+        }
+    }
+
+    // Queues p to be deleted by a later drain().
+    template<typename T>
+    void retire(T* p)
+    {
+        push(p, &destroy<T>);
+    }
+
+    // Destroys the objects queued so far on the calling thread and returns
+    // how many there were. Objects queued by their destructors are left for
+    // the next call. Those destructors must not call drain() on the same
+    // queue, which would deadlock.
+    std::size_t drain()
+    {
+        std::lock_guard<std::mutex> draining(drain_mutex_);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            batch_.swap(pending_);
+        }
+        if (batch_.empty())
+            return 0;
+
+        std::chrono::nanoseconds lag = clock::now() - batch_.front().retired;
+        for (std::size_t i = 0; i < batch_.size(); ++i)
+            batch_[i].destroy(batch_[i].object);
+        std::size_t n = batch_.size();
+        batch_.clear();
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.reclaimed += n;
+        ++stats_.batches;
+        stats_.last_lag = lag;
+        if (lag > stats_.max_lag)
+            stats_.max_lag = lag;
+        return n;
+    }
+
+    // Blocks until batch_size objects are waiting, timeout has passed, or
+    // wake() is called.
+    template<class Rep, class Period>
+    void wait(std::chrono::duration<Rep, Period> timeout)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait_for(lock, timeout, [this]() { return woken_ || pending_.size() >= batch_size_; });
+        woken_ = false;
+    }
+
+    void wake()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            woken_ = true;
+        }
+        cv_.notify_all();
+    }
+
+    reclaim_stats stats() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        reclaim_stats s = stats_;
+        s.depth = pending_.size();
+        return s;
+    }
+
+private:
+    reclaim_queue(const reclaim_queue&);
+    reclaim_queue& operator=(const reclaim_queue&);
+
+    struct entry
+    {
+        void* object;
+        void (*destroy)(void*);
+        clock::time_point retired;
+    };
+
+    template<typename T>
+    static void destroy(void* p)
+    {
+        delete static_cast<T*>(p);
+    }
+
+    void push(void* p, void (*destroy)(void*))
+    {
+        entry e = { p, destroy, clock::now() };
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (pending_.size() >= capacity_)
+        {
+            ++stats_.inline_reclaims;
+            lock.unlock();
+            destroy(p);
+            return;
+        }
+        try
+        {
+            pending_.push_back(e);
+        }
+        catch (...)
+        {
+            // runs inside a deleter, so it may not throw
+            ++stats_.inline_reclaims;
+            lock.unlock();
+            destroy(p);
+            return;
+        }
+        ++stats_.deferred;
+        if (pending_.size() > stats_.max_depth)
+            stats_.max_depth = pending_.size();
+        bool full_batch = pending_.size() == batch_size_;
+        lock.unlock();
+        if (full_batch)
+            cv_.notify_one();
+    }
+
+    const std::size_t capacity_;
+    const std::size_t batch_size_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    std::vector<entry> pending_;
+    bool woken_;
+    reclaim_stats stats_;
+
+    std::mutex drain_mutex_;
+    std::vector<entry> batch_;
+};
+
+//
+// reclaim_thread
+//
+// Drains a reclaim_queue in the background whenever a batch is waiting, and
+// at least every interval. Its destructor stops the thread and drains what
+// is left.
+//
+
+class reclaim_thread
+{
+public:
+    explicit reclaim_thread(reclaim_queue& queue, std::chrono::milliseconds interval = std::chrono::milliseconds(10))
+        : queue_(queue), interval_(interval), stop_(false)
+    {
+        thread_ = std::thread([this]() { run(); });
+    }
+
+    ~reclaim_thread()
+    {
+        stop_.store(true);
+        queue_.wake();
+        thread_.join();
+        queue_.drain();
+    }
+
+private:
+    reclaim_thread(const reclaim_thread&);
+    reclaim_thread& operator=(const reclaim_thread&);
+
+    void run()
+    {
+        while (!stop_.load())
+        {
+            queue_.wait(interval_);
+            queue_.drain();
+        }
+    }
+
+    reclaim_queue& queue_;
+    std::chrono::milliseconds interval_;
+    std::atomic<bool> stop_;
+    std::thread thread_;
+};
+
+//
+// deferred_deleter
+//
+// Deleter for safe_ptr(U*, D) and std::shared_ptr that hands the object to a
+// reclaim_queue instead of deleting it.
+//
+
+template<typename T>
+class deferred_deleter
+{
+public:
+    explicit deferred_deleter(reclaim_queue& queue)
+        : queue_(&queue)
+    {
+    }
+
+    void operator()(T* p) const
+    {
+        queue_->retire(p);
+    }
+
+    reclaim_queue& queue() const
+    {
+        return *queue_;
+    }
+
+private:
+    reclaim_queue* queue_;
+};
+
+//
+// make_safe_deferred
+//
+// make_safe for objects whose destruction should stay off the thread that
+// releases them last. The object and its control block are separate
+// allocations, since the control block is freed as soon as the object is
+// queued.
+//
+
+template<typename T, typename... Args>
+safe_ptr<T> make_safe_deferred(reclaim_queue& queue, Args&&... args)
+{
+    return safe_ptr<T>(new T(std::forward<Args>(args)...), deferred_deleter<T>(queue));
+}
+
+} // namespace
@@ -0,0 +1,279 @@
+#pragma once
+
+#include "safe_ptr.hpp"
+
+#include <cstdint>
+
+namespace spl
+{
+
+template<typename T, unsigned Bits> class tagged_safe_ptr;
+
+namespace detail
+{
+    struct tagged_safe_ptr_access
+    {
+        template<typename T, unsigned Bits, typename U>
+        static tagged_safe_ptr<T, Bits> alias(const tagged_safe_ptr<U, Bits>& own, T* p)
+        {
+            return tagged_safe_ptr<T, Bits>(detail::alias(own.p_, tagged_safe_ptr<T, Bits>::pack(p, own.tag())), unchecked_tag());
+        }
+
+        template<typename T, unsigned Bits, typename U>
+        static tagged_safe_ptr<T, Bits> alias(tagged_safe_ptr<U, Bits>&& own, T* p)
+        {
+            T* packed = tagged_safe_ptr<T, Bits>::pack(p, own.tag());
+            return tagged_safe_ptr<T, Bits>(detail::alias(std::move(own.p_), packed), unchecked_tag());
+        }
+    };
+}
+
+//
+// tagged_safe_ptr
+//
+// A safe_ptr with Bits bits of user data kept in the low bits of its stored
+// pointer, which T's alignment leaves zero. It stays two words, the same as
+// safe_ptr, where a safe_ptr and a separate flag would usually be padded to
+// three. The tag travels with copies and casts and does not take part in
+// comparisons.
+//
+// The owner is a std::shared_ptr aliased to the tagged address, so changing
+// the tag re-aliases it: free of reference count traffic from C++20, one
+// increment and one decrement before that. Tag changes are not atomic; a
+// tagged_safe_ptr shared between threads needs the same locking as a
+// safe_ptr would.
+//
+// As with safe_ptr, a moved-from tagged_safe_ptr may only be destroyed,
+// assigned to or swapped.
+//
+
+template<typename T, unsigned Bits = 1>
+class tagged_safe_ptr
+{
+    template <typename, unsigned> friend class tagged_safe_ptr;
+    friend struct detail::tagged_safe_ptr_access;
+
+    static_assert(Bits > 0 && (std::size_t(1) << Bits) <= alignof(T), "T's alignment leaves fewer than Bits zero bits");
+public:
+    typedef T  element_type;
+    typedef std::uintptr_t tag_type;
+
+    static const tag_type tag_mask = (tag_type(1) << Bits) - 1;
+
+    template<typename U>
+    explicit tagged_safe_ptr(const safe_ptr<U>& p, tag_type tag = 0, typename std::enable_if<std::is_convertible<U*, T*>::value, void*>::type = 0)
+        : p_(detail::alias(detail::safe_ptr_access::shared(p), pack(p.get(), tag)))
+    {
+    }
+
+    template<typename U>
+    explicit tagged_safe_ptr(safe_ptr<U>&& p, tag_type tag = 0, typename std::enable_if<std::is_convertible<U*, T*>::value, void*>::type = 0)
+        : p_()
+    {
+        T* packed = pack(p.get(), tag);
+        p_ = detail::alias(std::move(p).into_shared(), packed);
+    }
+
+    template<typename U>
+    tagged_safe_ptr(const tagged_safe_ptr<U, Bits>& other, typename std::enable_if<std::is_convertible<U*, T*>::value, void*>::type = 0)
+        : p_(detail::alias(other.p_, pack(other.get(), other.tag())))
+    {
+    }
+
+    template<typename U>
+    tagged_safe_ptr(tagged_safe_ptr<U, Bits>&& other, typename std::enable_if<std::is_convertible<U*, T*>::value, void*>::type = 0) noexcept
+        : p_()
+    {
+        T* packed = pack(other.get(), other.tag());
+        p_ = detail::alias(std::move(other.p_), packed);
+    }
+
+    T& operator*() const
+    {
+        return *get();
+    }
+
+    T* operator->() const
+    {
+        return get();
+    }
+
+    T* get() const
+    {
+        assert(p_ && "use of moved-from tagged_safe_ptr");
+        return reinterpret_cast<T*>(reinterpret_cast<std::uintptr_t>(p_.get()) & ~tag_mask);
+    }
+
+    tag_type tag() const
+    {
+        assert(p_ && "use of moved-from tagged_safe_ptr");
+        return reinterpret_cast<std::uintptr_t>(p_.get()) & tag_mask;
+    }
+
+    void set_tag(tag_type tag)
+    {
+        T* packed = pack(get(), tag);
+        p_ = detail::alias(std::move(p_), packed);
+    }
+
+    bool unique() const
+    {
+        return use_count() == 1;
+    }
+
+    long use_count() const
+    {
+        return p_.use_count();
+    }
+
+    void swap(tagged_safe_ptr& other) noexcept
+    {
+        p_.swap(other.p_);
+    }
+
+    // The pointer without its tag.
+    operator safe_ptr<T>() const &
+    {
+        return detail::safe_ptr_access::adopt(detail::alias(p_, get()));
+    }
+
+    operator safe_ptr<T>() &&
+    {
+        T* p = get();
+        return detail::safe_ptr_access::adopt(detail::alias(std::move(p_), p));
+    }
+
+private:
+    tagged_safe_ptr(std::shared_ptr<T>&& p, detail::unchecked_tag) noexcept
+        : p_(std::move(p))
+    {
+    }
+
+    static T* pack(T* p, tag_type tag)
+    {
+        assert(!(reinterpret_cast<std::uintptr_t>(p) & tag_mask) && "pointer not aligned enough for tagged_safe_ptr");
+        assert(!(tag & ~tag_mask) && "tag does not fit in Bits bits");
+        return reinterpret_cast<T*>(reinterpret_cast<std::uintptr_t>(p) | tag);
+    }
+
+    std::shared_ptr<T> p_;
+};
+
+template<class T, class U, unsigned Bits>
+bool operator==(const tagged_safe_ptr<T, Bits>& a, const tagged_safe_ptr<U, Bits>& b)
+{
+    return a.get() == b.get();
+}
+
+template<class T, class U, unsigned Bits>
+bool operator!=(const tagged_safe_ptr<T, Bits>& a, const tagged_safe_ptr<U, Bits>& b)
+{
+    return a.get() != b.get();
+}
+
+template<class T, class U, unsigned Bits>
+bool operator<(const tagged_safe_ptr<T, Bits>& a, const tagged_safe_ptr<U, Bits>& b)
+{
+    return a.get() < b.get();
+}
+
+template<class T, class U, unsigned Bits>
+bool operator>(const tagged_safe_ptr<T, Bits>& a, const tagged_safe_ptr<U, Bits>& b)
+{
+    return a.get() > b.get();
+}
+
+template<class T, class U, unsigned Bits>
+bool operator>=(const tagged_safe_ptr<T, Bits>& a, const tagged_safe_ptr<U, Bits>& b)
+{
+    return a.get() >= b.get();
+}
+
+template<class T, class U, unsigned Bits>
+bool operator<=(const tagged_safe_ptr<T, Bits>& a, const tagged_safe_ptr<U, Bits>& b)
+{
+    return a.get() <= b.get();
+}
+
+template<class T, class U, unsigned Bits>
+bool operator==(const tagged_safe_ptr<T, Bits>& a, const safe_ptr<U>& b)
+{
+    return a.get() == b.get();
+}
+
+template<class T, class U, unsigned Bits>
+bool operator!=(const tagged_safe_ptr<T, Bits>& a, const safe_ptr<U>& b)
+{
+    return a.get() != b.get();
+}
+
+template<class E, class T, class U, unsigned Bits>
+std::basic_ostream<E, T>& operator<<(std::basic_ostream<E, T>& out, const tagged_safe_ptr<U, Bits>& p)
+{
+    return out << p.get();
+}
+
+template<class T, unsigned Bits>
+void swap(tagged_safe_ptr<T, Bits>& a, tagged_safe_ptr<T, Bits>& b) noexcept
+{
+    a.swap(b);
+}
+
+template<class T, unsigned Bits>
+T* get_pointer(tagged_safe_ptr<T, Bits> const& p)
+{
+    return p.get();
+}
+
+//
+// pointer casts
+//
+// The result keeps the tag, so the target type must be aligned at least as
+// strictly as the source.
+//
+
+template <class T, class U, unsigned Bits>
+tagged_safe_ptr<T, Bits> static_pointer_cast(const tagged_safe_ptr<U, Bits>& p)
+{
+    return detail::tagged_safe_ptr_access::alias(p, static_cast<T*>(p.get()));
+}
+
+template <class T, class U, unsigned Bits>
+tagged_safe_ptr<T, Bits> static_pointer_cast(tagged_safe_ptr<U, Bits>&& p)
+{
+    T* t = static_cast<T*>(p.get());
+    return detail::tagged_safe_ptr_access::alias(std::move(p), t);
+}
+
+template <class T, class U, unsigned Bits>
+tagged_safe_ptr<T, Bits> const_pointer_cast(const tagged_safe_ptr<U, Bits>& p)
+{
+    return detail::tagged_safe_ptr_access::alias(p, const_cast<T*>(p.get()));
+}
+
+template <class T, class U, unsigned Bits>
+tagged_safe_ptr<T, Bits> const_pointer_cast(tagged_safe_ptr<U, Bits>&& p)
+{
+    T* t = const_cast<T*>(p.get());
+    return detail::tagged_safe_ptr_access::alias(std::move(p), t);
+}
+
+template <class T, class U, unsigned Bits>
+tagged_safe_ptr<T, Bits> dynamic_pointer_cast(const tagged_safe_ptr<U, Bits>& p)
+{
+    T* t = dynamic_cast<T*>(p.get());
+    if(!t)
+        throw std::bad_cast();
+    return detail::tagged_safe_ptr_access::alias(p, t);
+}
+
+template <class T, class U, unsigned Bits>
+tagged_safe_ptr<T, Bits> dynamic_pointer_cast(tagged_safe_ptr<U, Bits>&& p)
+{
+    T* t = dynamic_cast<T*>(p.get());
+    if(!t)
+        throw std::bad_cast();
+    return detail::tagged_safe_ptr_access::alias(std::move(p), t);
+}
+
+} // namespace
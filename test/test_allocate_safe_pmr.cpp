@@ -0,0 +1,41 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE safe_ptr_pmr
+#include <boost/test/unit_test.hpp>
+
+#include "safe_ptr.hpp"
+
+#ifdef SPL_HAS_MEMORY_RESOURCE
+
+#include <memory_resource>
+#include <vector>
+
+using namespace spl;
+
+struct node
+{
+    int value;
+    std::vector<safe_ptr<node> > children;
+
+    explicit node(int v) : value(v) {}
+};
+
+BOOST_AUTO_TEST_CASE( test_pmr_allocate_safe )
+{
+    char buffer[4096];
+    std::pmr::monotonic_buffer_resource arena(buffer, sizeof(buffer), std::pmr::null_memory_resource());
+    {
+        safe_ptr<node> root = pmr::allocate_safe<node>(&arena, 1);
+        root->children.push_back(pmr::allocate_safe<node>(&arena, 2));
+        root->children.push_back(pmr::allocate_safe<node>(&arena, 3));
+
+        const char* begin = buffer;
+        const char* end = buffer + sizeof(buffer);
+        BOOST_CHECK(reinterpret_cast<const char*>(root.get()) >= begin);
+        BOOST_CHECK(reinterpret_cast<const char*>(root.get()) < end);
+        BOOST_CHECK(reinterpret_cast<const char*>(root->children[1].get()) < end);
+        BOOST_CHECK_EQUAL(root->children[1]->value, 3);
+    }
+    arena.release();
+}
+
+#endif
@@ -0,0 +1,94 @@
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include "atomic_safe_ptr.hpp"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace spl;
+
+namespace
+{
+
+std::atomic<int> live_configs(0);
+
+struct config
+{
+    int version;
+    int check; // always -version, to detect torn reads
+
+    explicit config(int v) : version(v), check(-v) { ++live_configs; }
+    ~config() { --live_configs; }
+};
+
+}
+
+BOOST_AUTO_TEST_CASE( test_atomic_safe_ptr )
+{
+    {
+        safe_ptr<config> first = make_safe<config>(1);
+        atomic_safe_ptr<config> published(first);
+        BOOST_CHECK(published.is_lock_free());
+        BOOST_CHECK(published.load() == first);
+
+        safe_ptr<config> second = make_safe<config>(2);
+        BOOST_CHECK(published.exchange(second) == first);
+        BOOST_CHECK(published.load() == second);
+        BOOST_CHECK_EQUAL(published.version(), 1u);
+
+        safe_ptr<config> expected = first;
+        BOOST_CHECK(!published.compare_exchange_strong(expected, make_safe<config>(3)));
+        BOOST_CHECK(expected == second);
+        BOOST_CHECK(published.compare_exchange_strong(expected, first));
+        BOOST_CHECK(published.load() == first);
+        BOOST_CHECK_EQUAL(published.version(), 2u);
+
+        published.store(make_safe<config>(4));
+        BOOST_CHECK_EQUAL(published.load()->version, 4);
+        BOOST_CHECK_EQUAL(first.use_count(), 1);
+    }
+    BOOST_CHECK_EQUAL(live_configs.load(), 0);
+}
+
+BOOST_AUTO_TEST_CASE( test_atomic_safe_ptr_concurrent )
+{
+    {
+        atomic_safe_ptr<config> published(make_safe<config>(0));
+        std::atomic<bool> done(false);
+        std::atomic<int> torn(0);
+
+        std::vector<std::thread> readers;
+        for (int t = 0; t < 4; ++t)
+        {
+            readers.push_back(std::thread([&, t]() {
+                cached_safe_ptr<config> cached(published);
+                int last = 0;
+                while (!done.load())
+                {
+                    safe_ptr<config> c = (t % 2) ? published.load() : cached.get();
+                    if (c->check != -c->version || c->version < last)
+                        ++torn;
+                    last = c->version;
+                }
+            }));
+        }
+
+        for (int v = 1; v <= 20000; ++v)
+        {
+            if (v % 3)
+                published.store(make_safe<config>(v));
+            else
+                published.exchange(make_safe<config>(v));
+        }
+        done = true;
+        for (size_t t = 0; t < readers.size(); ++t)
+            readers[t].join();
+
+        BOOST_CHECK_EQUAL(torn.load(), 0);
+        BOOST_CHECK_EQUAL(published.load()->version, 20000);
+        BOOST_CHECK_EQUAL(live_configs.load(), 1);
+    }
+    BOOST_CHECK_EQUAL(live_configs.load(), 0);
+}
@@ -0,0 +1,138 @@
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include "biased_safe_ptr.hpp"
+
+#include <atomic>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+using namespace spl;
+
+namespace
+{
+
+struct account
+{
+  static std::atomic<int> alive;
+  int balance;
+
+  account() : balance(0) { ++alive; }
+  explicit account(int b) : balance(b) { ++alive; }
+  virtual ~account() { --alive; }
+};
+
+std::atomic<int> account::alive(0);
+
+struct savings : account
+{
+  explicit savings(int b) : account(b) {}
+};
+
+struct checking : account
+{
+};
+
+}
+
+BOOST_AUTO_TEST_CASE( test_biased_safe_ptr )
+{
+  {
+    biased_safe_ptr<savings> s = make_biased_safe<savings>(5);
+    BOOST_CHECK_EQUAL(s->balance, 5);
+
+    biased_safe_ptr<account> a(s);
+    biased_safe_ptr<account> b;
+    BOOST_CHECK_EQUAL(b->balance, 0);
+    b = a;
+    BOOST_CHECK(b == s);
+    BOOST_CHECK_EQUAL(account::alive.load(), 1);
+
+    biased_safe_ptr<savings> d = dynamic_pointer_cast<savings>(b);
+    BOOST_CHECK_THROW(dynamic_pointer_cast<checking>(b), std::bad_cast);
+    biased_safe_ptr<const savings> c = const_pointer_cast<const savings>(std::move(d));
+    BOOST_CHECK_EQUAL(c->balance, 5);
+
+    biased_safe_ptr<int> balance(s, &s->balance);
+    BOOST_CHECK_EQUAL(*balance, 5);
+    BOOST_CHECK_THROW(biased_safe_ptr<int>(s, static_cast<int*>(0)), std::invalid_argument);
+
+    std::unordered_set<biased_safe_ptr<account> > set;
+    set.insert(a);
+    BOOST_CHECK(set.count(b) == 1);
+
+    safe_ptr<savings> shared = s;
+    s = make_biased_safe<savings>(6);
+    a = s;
+    b = s;
+    c = s;
+    balance = biased_safe_ptr<int>(s, &s->balance);
+    set.clear();
+    BOOST_CHECK_EQUAL(account::alive.load(), 2);
+    BOOST_CHECK_EQUAL(shared->balance, 5);
+  }
+  BOOST_CHECK_EQUAL(account::alive.load(), 0);
+}
+
+BOOST_AUTO_TEST_CASE( test_biased_safe_ptr_shared_with_threads )
+{
+  std::vector<biased_safe_ptr<account> > objects;
+  for (int i = 0; i < 16; ++i)
+    objects.push_back(make_biased_safe<account>(i));
+
+  // Boost.Test is not thread-safe, so the threads only record their results
+  std::vector<int> sums(4);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t)
+  {
+    // each thread gets references made here and releases them there
+    std::vector<biased_safe_ptr<account> > mine(objects);
+    threads.push_back(std::thread([mine, &sums, t]() mutable {
+      int sum = 0;
+      for (int round = 0; round < 1000; ++round)
+        for (std::size_t i = 0; i < mine.size(); ++i)
+        {
+          biased_safe_ptr<account> copy(mine[i]);
+          sum += copy->balance;
+        }
+      sums[t] = sum;
+      mine.clear();
+    }));
+  }
+  for (std::size_t t = 0; t < threads.size(); ++t)
+  {
+    threads[t].join();
+    BOOST_CHECK_EQUAL(sums[t], 1000 * 120);
+  }
+
+  BOOST_CHECK_EQUAL(account::alive.load(), 16);
+  objects.clear();
+  merge_biased_safe();
+  BOOST_CHECK_EQUAL(account::alive.load(), 0);
+}
+
+BOOST_AUTO_TEST_CASE( test_biased_safe_ptr_released_elsewhere )
+{
+  // the only reference moves to another thread, which releases it; the
+  // object is freed once its owner merges
+  biased_safe_ptr<account> a = make_biased_safe<account>(1);
+  int balance = 0;
+  std::thread([&balance](biased_safe_ptr<account> p) { balance = p->balance; }, std::move(a)).join();
+  BOOST_CHECK_EQUAL(balance, 1);
+  BOOST_CHECK_EQUAL(account::alive.load(), 1);
+  merge_biased_safe();
+  BOOST_CHECK_EQUAL(account::alive.load(), 0);
+
+  // made on a thread that has exited by the time it is released
+  biased_safe_ptr<account> orphan = make_biased_safe<account>();
+  std::thread([&orphan]() { orphan = make_biased_safe<account>(2); }).join();
+  merge_biased_safe();
+  BOOST_CHECK_EQUAL(account::alive.load(), 1);
+  BOOST_CHECK_EQUAL(orphan->balance, 2);
+  biased_safe_ptr<account> copy(orphan);
+  orphan = copy;
+  copy = make_biased_safe<account>(3);
+  orphan = copy;
+  BOOST_CHECK_EQUAL(account::alive.load(), 1);
+}
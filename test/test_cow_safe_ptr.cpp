@@ -0,0 +1,151 @@
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include "cow_safe_ptr.hpp"
+
+#include <string>
+#include <vector>
+
+using namespace spl;
+
+namespace
+{
+
+struct order_book
+{
+    std::vector<int> bids;
+    std::vector<int> asks;
+
+    order_book() {}
+    order_book(std::initializer_list<int> b) : bids(b) {}
+};
+
+struct parameters
+{
+    static int made;
+    int limit;
+
+    explicit parameters(int l) : limit(l) {}
+
+    static safe_ptr<parameters> make_safe(int l)
+    {
+        ++made;
+        return safe_ptr<parameters>(new parameters(l));
+    }
+
+    static safe_ptr<parameters> make_safe(const parameters& other)
+    {
+        ++made;
+        return safe_ptr<parameters>(new parameters(other));
+    }
+};
+
+int parameters::made = 0;
+
+struct quote
+{
+    int price;
+
+    quote() : price(0) {}
+};
+
+struct firm_quote : quote
+{
+    int size;
+
+    firm_quote() : size(0) {}
+};
+
+struct instrument
+{
+    virtual ~instrument() {}
+    virtual const char* kind() const = 0;
+    virtual safe_ptr<instrument> clone() const = 0;
+
+    static safe_ptr<instrument> make_safe(const instrument& other)
+    {
+        return other.clone();
+    }
+};
+
+struct bond : instrument
+{
+    const char* kind() const { return "bond"; }
+    safe_ptr<instrument> clone() const { return safe_ptr<instrument>(new bond(*this)); }
+};
+
+}
+
+BOOST_AUTO_TEST_CASE( test_cow_safe_ptr_clones_on_shared_write )
+{
+    cow_safe_ptr<order_book> a = make_cow_safe<order_book>(std::initializer_list<int>{ 100, 99 });
+    cow_safe_ptr<order_book> b = a;
+    BOOST_CHECK_EQUAL(a.use_count(), 2);
+    BOOST_CHECK(a.get() == b.get());
+    BOOST_CHECK_EQUAL(b->bids.size(), 2u); // const access shares
+    BOOST_CHECK(a.get() == b.get());
+
+    b.write().bids.push_back(98);
+    BOOST_CHECK(a.get() != b.get());
+    BOOST_CHECK_EQUAL(a->bids.size(), 2u);
+    BOOST_CHECK_EQUAL(b->bids.size(), 3u);
+    BOOST_CHECK(a.unique());
+    BOOST_CHECK(b.unique());
+
+    const order_book* before = b.get();
+    b.write().asks.push_back(101);
+    BOOST_CHECK(b.get() == before); // unique, written in place
+}
+
+BOOST_AUTO_TEST_CASE( test_cow_safe_ptr_shares_with_safe_ptr )
+{
+    cow_safe_ptr<order_book> a = make_cow_safe<order_book>();
+    safe_ptr<const order_book> snapshot = a;
+    BOOST_CHECK_EQUAL(a.use_count(), 2);
+    a.write().bids.push_back(1);
+    BOOST_CHECK(snapshot->bids.empty());
+    BOOST_CHECK_EQUAL(a->bids.size(), 1u);
+}
+
+BOOST_AUTO_TEST_CASE( test_cow_safe_ptr_edit_clones_once )
+{
+    cow_safe_ptr<order_book> a = make_cow_safe<order_book>();
+    cow_safe_ptr<order_book> b = a;
+    {
+        cow_write_guard<order_book> w = b.edit();
+        const order_book* clone = b.get();
+        BOOST_CHECK(clone != a.get());
+        for (int i = 0; i < 10; ++i)
+            w->bids.push_back(i);
+        (*w).asks.push_back(0);
+        BOOST_CHECK(b.get() == clone);
+    }
+    BOOST_CHECK_EQUAL(b->bids.size(), 10u);
+    BOOST_CHECK(a->bids.empty());
+}
+
+BOOST_AUTO_TEST_CASE( test_cow_safe_ptr_uses_make_safe_hook )
+{
+    cow_safe_ptr<parameters> a = make_cow_safe<parameters>(5);
+    BOOST_CHECK_EQUAL(parameters::made, 1);
+    cow_safe_ptr<parameters> b = a;
+    b.write().limit = 6;
+    BOOST_CHECK_EQUAL(parameters::made, 2);
+    b.write().limit = 7;
+    BOOST_CHECK_EQUAL(parameters::made, 2);
+    BOOST_CHECK_EQUAL(a->limit, 5);
+    BOOST_CHECK_EQUAL(b->limit, 7);
+}
+
+BOOST_AUTO_TEST_CASE( test_cow_safe_ptr_keeps_dynamic_type )
+{
+    BOOST_CHECK((std::is_constructible<cow_safe_ptr<quote>, safe_ptr<quote> >::value));
+    BOOST_CHECK((!std::is_constructible<cow_safe_ptr<quote>, safe_ptr<firm_quote> >::value));
+
+    cow_safe_ptr<instrument> a(safe_ptr<instrument>(new bond));
+    cow_safe_ptr<instrument> b = a;
+    instrument& written = b.write();
+    BOOST_CHECK(b.get() != a.get());
+    BOOST_CHECK(dynamic_cast<bond*>(&written) != 0);
+    BOOST_CHECK_EQUAL(std::string(b->kind()), "bond");
+}
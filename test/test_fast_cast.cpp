@@ -0,0 +1,91 @@
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include "fast_cast.hpp"
+
+using namespace spl;
+
+namespace
+{
+
+struct message : fast_castable
+{
+  SPL_FAST_CAST(message, fast_castable)
+};
+
+struct order : message
+{
+  SPL_FAST_CAST(order, message)
+  int quantity;
+  order() : quantity(10) {}
+};
+
+struct limit_order : order
+{
+  SPL_FAST_CAST(limit_order, order)
+};
+
+struct cancel : message
+{
+  SPL_FAST_CAST(cancel, message)
+};
+
+// not registered: its objects are seen as orders, and it cannot be a cast
+// target
+struct market_order : order
+{
+};
+
+}
+
+BOOST_AUTO_TEST_CASE( test_fast_dynamic_cast )
+{
+  limit_order l;
+  message* m = &l;
+  BOOST_CHECK(fast_dynamic_cast<order>(m) == &l);
+  BOOST_CHECK(fast_dynamic_cast<limit_order>(m) == &l);
+  BOOST_CHECK(fast_dynamic_cast<message>(m) == m);
+  BOOST_CHECK(fast_dynamic_cast<cancel>(m) == 0);
+
+  const message* c = m;
+  BOOST_CHECK(fast_dynamic_cast<const limit_order>(c) == &l);
+
+  market_order mo;
+  m = &mo;
+  BOOST_CHECK(fast_dynamic_cast<order>(m) == &mo);
+  BOOST_CHECK(fast_dynamic_cast<limit_order>(m) == 0);
+
+  order o;
+  m = &o;
+  BOOST_CHECK(fast_dynamic_cast<limit_order>(m) == 0);
+}
+
+BOOST_AUTO_TEST_CASE( test_fast_cast_to_unregistered )
+{
+  // fast_dynamic_cast<market_order>(m) would compile to a wrong answer for a
+  // plain order, so it is rejected at compile time
+  BOOST_CHECK(is_fast_cast_registered<order>::value);
+  BOOST_CHECK(is_fast_cast_registered<const limit_order>::value);
+  BOOST_CHECK(is_fast_cast_registered<fast_castable>::value);
+  BOOST_CHECK(is_fast_cast_registered<market_order>::value == false);
+}
+
+BOOST_AUTO_TEST_CASE( test_fast_dynamic_pointer_cast )
+{
+  safe_ptr<message> m(make_safe<limit_order>());
+
+  safe_ptr<order> o = fast_dynamic_pointer_cast<order>(m);
+  BOOST_CHECK_EQUAL(o->quantity, 10);
+  BOOST_CHECK_EQUAL(m.use_count(), 2);
+  BOOST_CHECK_THROW(fast_dynamic_pointer_cast<cancel>(m), std::bad_cast);
+
+  BOOST_CHECK(!try_fast_dynamic_pointer_cast<cancel>(m));
+  maybe_safe_ptr<limit_order> l = try_fast_dynamic_pointer_cast<limit_order>(m);
+  BOOST_CHECK(l == maybe_safe_ptr<order>(o));
+
+  safe_ptr<message> n(m);
+  BOOST_CHECK_THROW(fast_dynamic_pointer_cast<cancel>(std::move(n)), std::bad_cast);
+  BOOST_CHECK(n == m);
+  safe_ptr<limit_order> moved = fast_dynamic_pointer_cast<limit_order>(std::move(n));
+  BOOST_CHECK_EQUAL(m.use_count(), 4);
+}
@@ -0,0 +1,127 @@
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include "lazy_safe_ptr.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+using namespace spl;
+
+namespace
+{
+
+struct counted
+{
+    static int made;
+    int i;
+
+    counted() : i(4) { ++made; }
+};
+
+int counted::made = 0;
+
+struct slow_to_make
+{
+    static std::atomic<int> made;
+
+    slow_to_make()
+    {
+        ++made;
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+};
+
+std::atomic<int> slow_to_make::made(0);
+
+struct palette
+{
+    static int made;
+    int colors;
+
+    palette() : colors(256) { ++made; }
+};
+
+int palette::made = 0;
+
+struct holder
+{
+    safe_ptr<const palette> p;
+};
+
+}
+
+namespace spl
+{
+    template<>
+    struct share_default_instance<palette> : std::true_type
+    {
+    };
+}
+
+BOOST_AUTO_TEST_CASE( test_lazy_safe_ptr )
+{
+  counted::made = 0;
+  std::vector<lazy_safe_ptr<counted> > slots(100);
+  BOOST_CHECK_EQUAL(counted::made, 0);
+  BOOST_CHECK(!slots[3].materialized());
+
+  BOOST_CHECK_EQUAL(slots[3]->i, 4);
+  BOOST_CHECK_EQUAL(counted::made, 1);
+  BOOST_CHECK(slots[3].materialized());
+  BOOST_CHECK(slots[3].get() == slots[3].get());
+
+  lazy_safe_ptr<counted> copy(slots[3]);
+  BOOST_CHECK(copy.get() == slots[3].get());
+  safe_ptr<counted> p = copy;
+  BOOST_CHECK_EQUAL(p.use_count(), 3);
+
+  slots[4] = p;
+  BOOST_CHECK(slots[4].get() == p.get());
+  BOOST_CHECK_EQUAL(counted::made, 1);
+
+  lazy_safe_ptr<counted> moved(std::move(slots[4]));
+  BOOST_CHECK(!slots[4].materialized());
+  BOOST_CHECK(moved.get() == p.get());
+  swap(moved, slots[5]);
+  BOOST_CHECK(!moved.materialized());
+  BOOST_CHECK(slots[5].get() == p.get());
+  BOOST_CHECK_EQUAL(p.use_count(), 4);
+  BOOST_CHECK_EQUAL(counted::made, 1);
+}
+
+BOOST_AUTO_TEST_CASE( test_lazy_safe_ptr_race )
+{
+  lazy_safe_ptr<slow_to_make> lazy;
+  std::vector<slow_to_make*> seen(8);
+  std::vector<std::thread> threads;
+  for (std::size_t t = 0; t < seen.size(); ++t)
+    threads.push_back(std::thread([&lazy, &seen, t]() { seen[t] = lazy.get(); }));
+  for (std::size_t t = 0; t < threads.size(); ++t)
+    threads[t].join();
+  for (std::size_t t = 0; t < seen.size(); ++t)
+    BOOST_CHECK(seen[t] == lazy.get());
+  BOOST_CHECK_EQUAL(slow_to_make::made.load(), 1);
+}
+
+BOOST_AUTO_TEST_CASE( test_share_default_instance )
+{
+  std::vector<holder> holders(50);
+  BOOST_CHECK_EQUAL(palette::made, 1);
+  BOOST_CHECK(holders[0].p == holders[49].p);
+  BOOST_CHECK_EQUAL(holders[0].p->colors, 256);
+  BOOST_CHECK_EQUAL(holders[0].p.use_count(), 0);
+  BOOST_CHECK(weak_safe_ptr<const palette>(holders[0].p).expired());
+
+  holders[0].p = make_safe<palette>();
+  BOOST_CHECK_EQUAL(palette::made, 2);
+  BOOST_CHECK(holders[0].p != holders[1].p);
+
+  // a mutable palette is never shared
+  safe_ptr<palette> mine;
+  BOOST_CHECK_EQUAL(palette::made, 3);
+  BOOST_CHECK(mine != holders[1].p);
+  BOOST_CHECK_EQUAL(mine.use_count(), 1);
+}
@@ -0,0 +1,101 @@
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include "local_safe_ptr.hpp"
+
+using namespace spl;
+
+namespace
+{
+
+int live_cells = 0;
+
+struct cell
+{
+    int value;
+    explicit cell(int v) : value(v) { ++live_cells; }
+    virtual ~cell() { --live_cells; }
+};
+
+struct formula : cell
+{
+    formula() : cell(0) {}
+};
+
+class registered_cell
+{
+    registered_cell(int v) : value(v) {}
+public:
+    int value;
+
+    static safe_ptr<registered_cell> make_safe(int v)
+    {
+        return safe_ptr<registered_cell>(new registered_cell(v * 10));
+    }
+};
+
+struct node : enable_safe_from_this<node>
+{
+    int value;
+    explicit node(int v) : value(v) {}
+};
+
+}
+
+BOOST_AUTO_TEST_CASE( test_local_safe_ptr )
+{
+    {
+        local_safe_ptr<cell> a = make_local_safe<cell>(4);
+        BOOST_CHECK_EQUAL(a->value, 4);
+        BOOST_CHECK_EQUAL(a.use_count(), 1);
+
+        local_safe_ptr<cell> b(a);
+        BOOST_CHECK_EQUAL(a.use_count(), 2);
+        local_safe_ptr<cell> c(std::move(b));
+        BOOST_CHECK_EQUAL(a.use_count(), 2);
+        BOOST_CHECK(c == a);
+
+        local_safe_ptr<const cell> d(c);
+        BOOST_CHECK_EQUAL(a.use_count(), 3);
+        BOOST_CHECK(const_pointer_cast<cell>(d) == a);
+        BOOST_CHECK_THROW(dynamic_pointer_cast<formula>(a), std::bad_cast);
+        BOOST_CHECK_EQUAL(live_cells, 1);
+    }
+    BOOST_CHECK_EQUAL(live_cells, 0);
+}
+
+BOOST_AUTO_TEST_CASE( test_local_safe_ptr_to_safe_ptr )
+{
+    safe_ptr<cell> s = make_safe<cell>(1);
+    {
+        local_safe_ptr<cell> f = make_local_safe<formula>();
+        local_safe_ptr<formula> g = static_pointer_cast<formula>(f);
+        s = safe_ptr<cell>(g);
+        BOOST_CHECK(s.get() == g.get());
+        BOOST_CHECK_EQUAL(f.use_count(), 2);
+    }
+    // the object outlives every local_safe_ptr through the converted safe_ptr
+    BOOST_CHECK_EQUAL(live_cells, 1);
+    BOOST_CHECK_EQUAL(s->value, 0);
+
+    local_safe_ptr<cell> h(s);
+    BOOST_CHECK(h == local_safe_ptr<cell>(h));
+    BOOST_CHECK(h.get() == s.get());
+}
+
+BOOST_AUTO_TEST_CASE( test_make_local_safe_uses_make_safe )
+{
+    local_safe_ptr<registered_cell> r = make_local_safe<registered_cell>(3);
+    BOOST_CHECK_EQUAL(r->value, 30);
+    safe_ptr<registered_cell> s(r);
+    BOOST_CHECK_EQUAL(s->value, 30);
+}
+
+BOOST_AUTO_TEST_CASE( test_make_local_safe_enables_safe_from_this )
+{
+    local_safe_ptr<node> n = make_local_safe<node>(5);
+    safe_ptr<node> s = n->safe_from_this();
+    BOOST_CHECK(s.get() == n.get());
+    // safe_ptrs are not counted
+    BOOST_CHECK_EQUAL(n.use_count(), 1);
+}
@@ -102,3 +102,70 @@ BOOST_AUTO_TEST_CASE( test_make_safe_only_non_variadic )
 }
 
 
+
+template<typename T>
+struct counting_allocator
+{
+    typedef T value_type;
+
+    int* count;
+
+    explicit counting_allocator(int* c) : count(c) {}
+
+    template<typename U>
+    counting_allocator(const counting_allocator<U>& other) : count(other.count) {}
+
+    T* allocate(std::size_t n)
+    {
+        ++*count;
+        return static_cast<T*>(::operator new(n * sizeof(T)));
+    }
+
+    void deallocate(T* p, std::size_t)
+    {
+        --*count;
+        ::operator delete(p);
+    }
+};
+
+template<typename T, typename U>
+bool operator==(const counting_allocator<T>& a, const counting_allocator<U>& b) { return a.count == b.count; }
+
+template<typename T, typename U>
+bool operator!=(const counting_allocator<T>& a, const counting_allocator<U>& b) { return a.count != b.count; }
+
+struct allocated
+{
+    int i;
+    allocated(int j, int k) : i(j + k) {}
+};
+
+class allocate_safe_only : noncopyable
+{
+    allocate_safe_only(int i) : i(i) {}
+public:
+    int i;
+
+    template<typename Alloc>
+    static safe_ptr<allocate_safe_only> allocate_safe(const Alloc& alloc, int i)
+    {
+        return safe_ptr<allocate_safe_only>(new allocate_safe_only(i + 1));
+    }
+};
+
+BOOST_AUTO_TEST_CASE( test_allocate_safe )
+{
+    int count = 0;
+    {
+        safe_ptr<allocated> p = allocate_safe<allocated>(counting_allocator<allocated>(&count), 1, 2);
+        BOOST_CHECK_EQUAL(p->i, 3);
+        BOOST_CHECK_EQUAL(count, 1);
+    }
+    BOOST_CHECK_EQUAL(count, 0);
+
+    safe_ptr<make_safe_only_3> o3 = allocate_safe<make_safe_only_3>(counting_allocator<int>(&count), 1, 2);
+    BOOST_CHECK_EQUAL(count, 0);
+
+    safe_ptr<allocate_safe_only> a = allocate_safe<allocate_safe_only>(counting_allocator<int>(&count), 1);
+    BOOST_CHECK_EQUAL(a->i, 2);
+}
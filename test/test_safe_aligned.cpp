@@ -0,0 +1,79 @@
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include "safe_aligned.hpp"
+
+#include <cstdint>
+#include <limits>
+
+using namespace spl;
+
+namespace
+{
+
+struct counter : enable_safe_from_this<counter>
+{
+  static int alive;
+  long hits;
+
+  explicit counter(long h) : hits(h) { ++alive; }
+  ~counter() { --alive; }
+};
+
+int counter::alive = 0;
+
+struct alignas(256) page
+{
+  char bytes[300];
+};
+
+struct fussy
+{
+  fussy() { throw std::runtime_error("fussy"); }
+};
+
+std::uintptr_t address(const void* p)
+{
+  return reinterpret_cast<std::uintptr_t>(p);
+}
+
+}
+
+BOOST_AUTO_TEST_CASE( test_make_safe_aligned )
+{
+  {
+    safe_ptr<counter> c = make_safe_aligned<counter>(3);
+    BOOST_CHECK_EQUAL(c->hits, 3);
+    BOOST_CHECK_EQUAL(address(c.get()) % SPL_CACHE_LINE_SIZE, 0u);
+    BOOST_CHECK(c->safe_from_this() == c);
+    BOOST_CHECK(get_deleter<detail::cache_aligned_delete<counter> >(c) != 0);
+
+    // the control block is on lines of its own as well
+    std::uintptr_t deleter = address(get_deleter<detail::cache_aligned_delete<counter> >(c));
+    BOOST_CHECK(deleter / SPL_CACHE_LINE_SIZE != address(c.get()) / SPL_CACHE_LINE_SIZE);
+    BOOST_CHECK_EQUAL(counter::alive, 1);
+  }
+  BOOST_CHECK_EQUAL(counter::alive, 0);
+
+  safe_ptr<page> p = make_safe_aligned<page>();
+  BOOST_CHECK_EQUAL(address(p.get()) % 256, 0u);
+
+  BOOST_CHECK_THROW(make_safe_aligned<fussy>(), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE( test_cache_aligned_allocator )
+{
+  cache_aligned_allocator<char> alloc;
+  char* a = alloc.allocate(1);
+  char* b = alloc.allocate(SPL_CACHE_LINE_SIZE + 1);
+  BOOST_CHECK_EQUAL(address(a) % SPL_CACHE_LINE_SIZE, 0u);
+  BOOST_CHECK_EQUAL(address(b) % SPL_CACHE_LINE_SIZE, 0u);
+  BOOST_CHECK(alloc == cache_aligned_allocator<int>());
+  alloc.deallocate(a, 1);
+  alloc.deallocate(b, SPL_CACHE_LINE_SIZE + 1);
+
+  std::size_t max = std::numeric_limits<std::size_t>::max();
+  BOOST_CHECK_THROW(alloc.allocate(max), std::bad_array_new_length);
+  BOOST_CHECK_THROW(cache_aligned_allocator<page>().allocate(max / 256), std::bad_array_new_length);
+  BOOST_CHECK_THROW(detail::allocate_aligned(max - SPL_CACHE_LINE_SIZE, SPL_CACHE_LINE_SIZE), std::bad_array_new_length);
+}
@@ -0,0 +1,76 @@
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include "safe_array.hpp"
+
+#include <numeric>
+
+using namespace spl;
+
+namespace
+{
+
+int live_orders = 0;
+
+struct order
+{
+    int price;
+    int quantity;
+
+    order(int p, int q) : price(p), quantity(q) { ++live_orders; }
+    order(const order& o) : price(o.price), quantity(o.quantity) { ++live_orders; }
+    ~order() { --live_orders; }
+};
+
+int constructed_before_throw = 0;
+
+struct fragile
+{
+    fragile()
+    {
+        if (constructed_before_throw == 3)
+            throw std::runtime_error("fragile");
+        ++constructed_before_throw;
+    }
+    ~fragile() { --constructed_before_throw; }
+};
+
+}
+
+BOOST_AUTO_TEST_CASE( test_make_safe_n )
+{
+    safe_ptr<order> third = make_safe<order>(0, 0);
+    {
+        safe_array<order> batch = make_safe_n<order>(5, 100, 2);
+        BOOST_CHECK_EQUAL(batch.size(), 5u);
+        BOOST_CHECK_EQUAL(live_orders, 6);
+        BOOST_CHECK_EQUAL(batch.end() - batch.begin(), 5);
+
+        batch[2].quantity = 7;
+        int total = 0;
+        for (order* o = batch.begin(); o != batch.end(); ++o)
+            total += o->quantity;
+        BOOST_CHECK_EQUAL(total, 15);
+
+        third = batch.handle(2);
+        BOOST_CHECK_EQUAL(third->quantity, 7);
+        BOOST_CHECK(third.get() == batch.data() + 2);
+        BOOST_CHECK_EQUAL(batch.use_count(), 2);
+        BOOST_CHECK_THROW(batch.handle(5), std::out_of_range);
+    }
+    // a handle keeps the whole batch alive
+    BOOST_CHECK_EQUAL(live_orders, 5);
+    BOOST_CHECK_EQUAL(third->price, 100);
+    third = make_safe<order>(1, 1);
+    BOOST_CHECK_EQUAL(live_orders, 1);
+
+    BOOST_CHECK_THROW(make_safe_n<order>(0, 1, 1), std::invalid_argument);
+    BOOST_CHECK_THROW(make_safe_n<order>(std::size_t(-1) / sizeof(order) + 1, 1, 1), std::bad_array_new_length);
+    BOOST_CHECK_THROW(make_safe_n<order>(std::size_t(-1) / sizeof(order), 1, 1), std::bad_array_new_length);
+}
+
+BOOST_AUTO_TEST_CASE( test_make_safe_n_constructor_throws )
+{
+    BOOST_CHECK_THROW(make_safe_n<fragile>(5), std::runtime_error);
+    BOOST_CHECK_EQUAL(constructed_before_throw, 0);
+}
@@ -0,0 +1,66 @@
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include "safe_intrusive_ptr.hpp"
+
+using namespace spl;
+
+namespace
+{
+
+int live_shapes = 0;
+
+struct shape : enable_safe_intrusive_from_this<shape>
+{
+    shape() { ++live_shapes; }
+    virtual ~shape() { --live_shapes; }
+};
+
+struct circle : shape
+{
+    int radius;
+    explicit circle(int r) : radius(r) {}
+};
+
+struct square : shape
+{
+};
+
+}
+
+BOOST_AUTO_TEST_CASE( test_safe_intrusive_ptr )
+{
+    BOOST_CHECK_EQUAL(sizeof(safe_intrusive_ptr<shape>), sizeof(shape*));
+    {
+        safe_intrusive_ptr<circle> c = make_safe_intrusive<circle>(3);
+        BOOST_CHECK_EQUAL(c->radius, 3);
+        BOOST_CHECK_EQUAL(c.use_count(), 1);
+
+        safe_intrusive_ptr<shape> s(c);
+        BOOST_CHECK_EQUAL(c.use_count(), 2);
+        BOOST_CHECK(s == c);
+
+        safe_intrusive_ptr<shape> t(std::move(s));
+        BOOST_CHECK_EQUAL(c.use_count(), 2);
+
+        safe_intrusive_ptr<shape> u = c->safe_from_this();
+        BOOST_CHECK_EQUAL(c.use_count(), 3);
+        BOOST_CHECK(get_pointer(u) == c.get());
+
+        safe_intrusive_ptr<circle> d = static_pointer_cast<circle>(std::move(u));
+        BOOST_CHECK_EQUAL(c.use_count(), 3);
+        safe_intrusive_ptr<circle> e = dynamic_pointer_cast<circle>(t);
+        BOOST_CHECK_EQUAL(c.use_count(), 4);
+        BOOST_CHECK_THROW(dynamic_pointer_cast<square>(t), std::bad_cast);
+        BOOST_CHECK_THROW(dynamic_pointer_cast<square>(std::move(t)), std::bad_cast);
+        BOOST_CHECK_EQUAL(c.use_count(), 4);
+
+        safe_intrusive_ptr<const circle> k = c;
+        safe_intrusive_ptr<circle> m = const_pointer_cast<circle>(k);
+        BOOST_CHECK(m == k);
+
+        BOOST_CHECK_THROW(safe_intrusive_ptr<shape>(static_cast<shape*>(0)), std::invalid_argument);
+        BOOST_CHECK_EQUAL(live_shapes, 1);
+    }
+    BOOST_CHECK_EQUAL(live_shapes, 0);
+}
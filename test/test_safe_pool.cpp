@@ -0,0 +1,97 @@
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include "safe_pool.hpp"
+
+#include <thread>
+#include <vector>
+
+using namespace spl;
+
+namespace
+{
+
+struct tick
+{
+    long sequence;
+    double price;
+
+    tick(long s, double p) : sequence(s), price(p) {}
+};
+
+struct quote : make_safe_from_pool<quote>
+{
+    int bid;
+    explicit quote(int b) : bid(b) {}
+};
+
+struct shipped : make_safe_from_pool<shipped>
+{
+};
+
+}
+
+BOOST_AUTO_TEST_CASE( test_pool_make_safe_recycles )
+{
+    const void* first;
+    {
+        safe_ptr<tick> t = pool_make_safe<tick>(1, 2.5);
+        BOOST_CHECK_EQUAL(t->sequence, 1);
+        first = t.get();
+    }
+    pool_stats before = pool_stats_for<tick>();
+    BOOST_CHECK_EQUAL(before.cached, 1u);
+    BOOST_CHECK_EQUAL(before.outstanding, 0u);
+
+    safe_ptr<tick> again = pool_make_safe<tick>(2, 3.5);
+    BOOST_CHECK(again.get() == first);
+    pool_stats after = pool_stats_for<tick>();
+    BOOST_CHECK_EQUAL(after.hits, before.hits + 1);
+    BOOST_CHECK_EQUAL(after.cached, 0u);
+    BOOST_CHECK(after.hit_rate() > 0.0);
+}
+
+BOOST_AUTO_TEST_CASE( test_make_safe_from_pool_hook )
+{
+    std::size_t misses = pool_stats_for<quote>().misses;
+    safe_ptr<quote> q = make_safe<quote>(42);
+    BOOST_CHECK_EQUAL(q->bid, 42);
+    BOOST_CHECK_EQUAL(pool_stats_for<quote>().misses, misses + 1);
+    BOOST_CHECK_EQUAL(pool_stats_for<quote>().outstanding, 1u);
+
+    BOOST_CHECK((detail::has_make_safe<quote, int>::value));
+    BOOST_CHECK((!detail::has_make_safe<quote, const char*>::value));
+    BOOST_CHECK((!detail::has_make_safe<quote>::value));
+}
+
+BOOST_AUTO_TEST_CASE( test_pool_remote_free_returns_in_batch )
+{
+    std::vector<safe_ptr<shipped> > batch;
+    for (int i = 0; i < 10; ++i)
+        batch.push_back(make_safe<shipped>());
+    BOOST_CHECK_EQUAL(pool_stats_for<shipped>().outstanding, 10u);
+
+    std::thread consumer([&batch]() { batch.clear(); });
+    consumer.join();
+    BOOST_CHECK_EQUAL(pool_stats_for<shipped>().cached, 0u);
+
+    safe_ptr<shipped> s = make_safe<shipped>();
+    pool_stats stats = pool_stats_for<shipped>();
+    BOOST_CHECK_EQUAL(stats.remote_batches, 1u);
+    BOOST_CHECK_EQUAL(stats.remote_returns, 10u);
+    BOOST_CHECK_EQUAL(stats.cached, 9u);
+    BOOST_CHECK_EQUAL(stats.outstanding, 1u);
+}
+
+BOOST_AUTO_TEST_CASE( test_pool_outlives_allocating_thread )
+{
+    std::vector<safe_ptr<tick> > survivors;
+    std::thread producer([&survivors]() {
+        for (int i = 0; i < 5; ++i)
+            survivors.push_back(pool_make_safe<tick>(i, 1.0));
+        pool_make_safe<tick>(99, 1.0); // freed locally, cached until exit
+    });
+    producer.join();
+    BOOST_CHECK_EQUAL(survivors[4]->sequence, 4);
+    survivors.clear();
+}
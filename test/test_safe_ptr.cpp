@@ -4,8 +4,10 @@
 #include <boost/test/unit_test.hpp>
 
 #include "safe_ptr.hpp"
+#include "safe_ptr_instrument.hpp"
 
 #include <functional>
+#include <vector>
 
 using namespace spl;
 
@@ -115,3 +117,244 @@ BOOST_AUTO_TEST_CASE( test_safe_this )
   BOOST_CHECK(weakie.expired());
 }
 
+
+BOOST_AUTO_TEST_CASE( test_safe_ptr_move )
+{
+  safe_ptr<number> p(make_safe<number>(7));
+  safe_ptr<number> q(p);
+  BOOST_CHECK_EQUAL(p.use_count(), 2);
+
+  safe_ptr<number> r(std::move(q));
+  BOOST_CHECK_EQUAL(p.use_count(), 2);
+  BOOST_CHECK_EQUAL(r->i, 7);
+
+  q = std::move(r);
+  BOOST_CHECK_EQUAL(p.use_count(), 2);
+  BOOST_CHECK(q == p);
+
+  safe_ptr<const number> c(std::move(q));
+  BOOST_CHECK_EQUAL(p.use_count(), 2);
+
+  std::shared_ptr<const number> s = std::move(c).into_shared();
+  BOOST_CHECK_EQUAL(p.use_count(), 2);
+  BOOST_CHECK_EQUAL(s->i, 7);
+
+  std::shared_ptr<number> t = safe_ptr<number>(p);
+  BOOST_CHECK_EQUAL(p.use_count(), 3);
+}
+
+BOOST_AUTO_TEST_CASE( test_safe_ptr_move_into_vector )
+{
+  std::vector<safe_ptr<number> > v;
+  safe_ptr<number> p(make_safe<number>(3));
+  for (int i = 0; i < 100; ++i)
+    v.push_back(p);
+  BOOST_CHECK_EQUAL(p.use_count(), 101);
+  v.push_back(make_safe<number>(4));
+  BOOST_CHECK_EQUAL(p.use_count(), 101);
+  BOOST_CHECK(std::is_nothrow_move_constructible<safe_ptr<number> >::value);
+}
+
+struct base
+{
+  virtual ~base() {}
+};
+
+struct derived : base
+{
+  int j;
+  derived() : j(5) {}
+};
+
+struct other : base
+{
+};
+
+BOOST_AUTO_TEST_CASE( test_pointer_casts )
+{
+  safe_ptr<base> b(make_safe<derived>());
+
+  safe_ptr<derived> d = static_pointer_cast<derived>(b);
+  BOOST_CHECK_EQUAL(d->j, 5);
+  BOOST_CHECK_EQUAL(b.use_count(), 2);
+
+  safe_ptr<const derived> c = const_pointer_cast<const derived>(d);
+  BOOST_CHECK_EQUAL(b.use_count(), 3);
+  safe_ptr<derived> m = const_pointer_cast<derived>(std::move(c));
+  BOOST_CHECK_EQUAL(b.use_count(), 3);
+
+  safe_ptr<derived> e = dynamic_pointer_cast<derived>(b);
+  BOOST_CHECK(e == b);
+  BOOST_CHECK_EQUAL(b.use_count(), 4);
+  BOOST_CHECK_THROW(dynamic_pointer_cast<other>(b), std::bad_cast);
+
+  safe_ptr<base> f(b);
+  BOOST_CHECK_THROW(dynamic_pointer_cast<other>(std::move(f)), std::bad_cast);
+  BOOST_CHECK(f == b);
+  BOOST_CHECK_EQUAL(b.use_count(), 5);
+
+  safe_ptr<derived> g = dynamic_pointer_cast<derived>(std::move(f));
+  BOOST_CHECK_EQUAL(b.use_count(), 5);
+  safe_ptr<derived> h = static_pointer_cast<derived>(safe_ptr<base>(std::move(g)));
+  BOOST_CHECK_EQUAL(b.use_count(), 5);
+}
+
+BOOST_AUTO_TEST_CASE( test_aliasing_constructor )
+{
+  safe_ptr<derived> d(make_safe<derived>());
+  safe_ptr<int> j(d, &d->j);
+  BOOST_CHECK_EQUAL(*j, 5);
+  BOOST_CHECK_EQUAL(d.use_count(), 2);
+
+  safe_ptr<int> k(std::move(j), &d->j);
+  BOOST_CHECK_EQUAL(d.use_count(), 2);
+
+  BOOST_CHECK_THROW(safe_ptr<int>(d, static_cast<int*>(0)), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE( test_try_dynamic_pointer_cast )
+{
+  safe_ptr<base> b(make_safe<derived>());
+
+  maybe_safe_ptr<other> o = try_dynamic_pointer_cast<other>(b);
+  BOOST_CHECK(!o);
+  BOOST_CHECK(o == nullptr);
+  BOOST_CHECK_THROW(o.value(), std::logic_error);
+  BOOST_CHECK_EQUAL(b.use_count(), 1);
+
+  maybe_safe_ptr<derived> d = try_dynamic_pointer_cast<derived>(b);
+  BOOST_REQUIRE(d);
+  BOOST_CHECK_EQUAL(d->j, 5);
+  BOOST_CHECK_EQUAL(b.use_count(), 2);
+
+  safe_ptr<derived> e = std::move(d).value();
+  BOOST_CHECK_EQUAL(b.use_count(), 2);
+  BOOST_CHECK(e == b);
+
+  safe_ptr<base> f(b);
+  BOOST_CHECK(!try_dynamic_pointer_cast<other>(std::move(f)));
+  BOOST_CHECK(f == b);
+
+  maybe_safe_ptr<base> g = try_dynamic_pointer_cast<derived>(std::move(f));
+  BOOST_CHECK(g == maybe_safe_ptr<derived>(e));
+  BOOST_CHECK_EQUAL(b.use_count(), 3);
+
+  safe_ptr<base> fallback(make_safe<other>());
+  BOOST_CHECK(maybe_safe_ptr<base>().value_or(fallback) == fallback);
+  BOOST_CHECK(g.value_or(fallback) == b);
+}
+
+namespace
+{
+
+int sum_of(safe_ref<const number> a, safe_ref<const number> b)
+{
+  return a->i + b->i;
+}
+
+int handler_value(safe_ref<event_handler> h)
+{
+  return h->i();
+}
+
+}
+
+BOOST_AUTO_TEST_CASE( test_safe_ref )
+{
+#ifndef SPL_SAFE_REF_DEBUG
+  BOOST_CHECK(std::is_trivially_copyable<safe_ref<number> >::value);
+  BOOST_CHECK_EQUAL(sizeof(safe_ref<number>), sizeof(number*));
+#endif
+
+  safe_ptr<number> p(make_safe<number>(2));
+  number n(3);
+  BOOST_CHECK_EQUAL(sum_of(p, safe_ref<number>(n)), 5);
+  BOOST_CHECK_EQUAL(p.use_count(), 1);
+
+  safe_ref<number> r(p);
+  safe_ref<const number> c(r);
+  BOOST_CHECK(c == p);
+  BOOST_CHECK(p == c);
+  BOOST_CHECK(c != safe_ref<number>(n));
+  BOOST_CHECK(get_pointer(c) == p.get());
+  BOOST_CHECK(r <= c && r >= c && !(r < c) && !(r > c));
+
+  // never from a temporary safe_ptr, which would die before the safe_ref
+  BOOST_CHECK((std::is_constructible<safe_ref<number>, const safe_ptr<number>&>::value));
+  BOOST_CHECK((!std::is_constructible<safe_ref<number>, safe_ptr<number> >::value));
+
+  safe_ptr<event_handler> h(make_safe<event_handler>(8));
+  safe_ref<event_handler> hr(h);
+  BOOST_CHECK_EQUAL(handler_value(hr), 8);
+  safe_ptr<event_handler> promoted = hr.promote();
+  BOOST_CHECK(promoted == h);
+  BOOST_CHECK_EQUAL(h.use_count(), 2);
+}
+
+BOOST_AUTO_TEST_CASE( test_weak_safe_ptr )
+{
+  weak_safe_ptr<event_handler> weak;
+  BOOST_CHECK(weak.expired());
+  BOOST_CHECK(!weak.lock());
+  {
+    safe_ptr<event_handler> handler = make_safe<event_handler>(7);
+    weak = handler;
+    BOOST_CHECK_EQUAL(handler.use_count(), 1);
+    maybe_safe_ptr<event_handler> locked = weak.lock();
+    BOOST_REQUIRE(locked);
+    BOOST_CHECK_EQUAL(locked->i(), 7);
+    BOOST_CHECK_EQUAL(weak.use_count(), 2);
+    BOOST_CHECK(!owner_less()(weak, handler) && !owner_less()(handler, weak));
+  }
+  BOOST_CHECK(weak.expired());
+  BOOST_CHECK(weak.lock() == nullptr);
+}
+
+BOOST_AUTO_TEST_CASE( test_weak_safe_ptr_sweeps )
+{
+  safe_ptr<event_handler> a = make_safe<event_handler>(1);
+  safe_ptr<event_handler> c = make_safe<event_handler>(3);
+  std::vector<weak_safe_ptr<event_handler> > observers;
+  observers.push_back(a);
+  observers.push_back(make_safe<event_handler>(2));
+  observers.push_back(c);
+  observers.push_back(make_safe<event_handler>(4));
+
+  int sum = 0;
+  BOOST_CHECK_EQUAL(for_each_alive(observers, [&sum](event_handler& h) { sum += h.i(); }), 2u);
+  BOOST_CHECK_EQUAL(sum, 4);
+  BOOST_CHECK_EQUAL(observers.size(), 2u);
+  BOOST_CHECK(observers[0].lock() == maybe_safe_ptr<event_handler>(a));
+  BOOST_CHECK(observers[1].lock() == maybe_safe_ptr<event_handler>(c));
+
+  a = c;
+  BOOST_CHECK_EQUAL(erase_expired(observers), 1u);
+  BOOST_CHECK_EQUAL(observers.size(), 1u);
+  BOOST_CHECK_EQUAL(erase_expired(observers), 0u);
+}
+
+BOOST_AUTO_TEST_CASE( test_static_safe_ptr )
+{
+  static derived global;
+  safe_ptr<derived> d = static_safe_ptr(global);
+  BOOST_CHECK_EQUAL(d->j, 5);
+  BOOST_CHECK_EQUAL(d.use_count(), 0);
+
+  safe_ptr<base> b(d);
+  safe_ptr<base> c(b);
+  BOOST_CHECK_EQUAL(c.use_count(), 0);
+  BOOST_CHECK(c == d);
+  BOOST_CHECK(dynamic_pointer_cast<derived>(c).get() == &global);
+  BOOST_CHECK(try_dynamic_pointer_cast<other>(c) == nullptr);
+
+  std::shared_ptr<base> s = c;
+  BOOST_CHECK(s.get() == &global);
+  BOOST_CHECK(weak_safe_ptr<base>(c).expired());
+}
+
+BOOST_AUTO_TEST_CASE( test_instrument_type_name )
+{
+  // same readable names whether or not SPL_SAFE_PTR_INSTRUMENT is defined
+  BOOST_CHECK_EQUAL(instrument::type_name<int>(), "int");
+  BOOST_CHECK_EQUAL(instrument::type_name<const int>(), "int");
+}
@@ -0,0 +1,108 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE safe_ptr_hash
+#include <boost/test/unit_test.hpp>
+
+#include "safe_ptr.hpp"
+
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+
+using namespace spl;
+
+namespace
+{
+
+struct session
+{
+    int id;
+    explicit session(int i) : id(i) {}
+};
+
+struct left_base { virtual ~left_base() {} int l; };
+struct right_base { virtual ~right_base() {} int r; };
+struct both : left_base, right_base {};
+
+}
+
+BOOST_AUTO_TEST_CASE( test_std_hash_safe_ptr )
+{
+    std::unordered_map<safe_ptr<session>, int> counts;
+    safe_ptr<session> a = make_safe<session>(1);
+    safe_ptr<session> b = make_safe<session>(2);
+    counts[a] = 10;
+    counts[b] = 20;
+    counts[a] += 1;
+    BOOST_CHECK_EQUAL(counts.size(), 2u);
+    BOOST_CHECK_EQUAL(counts[a], 11);
+    BOOST_CHECK_EQUAL(std::hash<safe_ptr<session> >()(a), ptr_hash<session>()(a.get()));
+    BOOST_CHECK_EQUAL(std::hash<safe_ref<session> >()(a), std::hash<safe_ptr<session> >()(a));
+    BOOST_CHECK_EQUAL(a.use_count(), 2);
+}
+
+BOOST_AUTO_TEST_CASE( test_hash_of_neighbouring_elements )
+{
+    // aliasing handles such as array elements are only 4 bytes apart
+    static int elements[64];
+    std::set<std::size_t> buckets;
+    for (int i = 0; i < 64; ++i)
+        buckets.insert(ptr_hash<int>()(&elements[i]) % 64);
+    BOOST_CHECK_GT(buckets.size(), 32u);
+
+    std::set<std::size_t> hashes;
+    for (int i = 0; i < 64; ++i)
+        hashes.insert(std::hash<safe_ptr<int> >()(static_safe_ptr(elements[i])));
+    BOOST_CHECK_EQUAL(hashes.size(), 64u);
+}
+
+BOOST_AUTO_TEST_CASE( test_ptr_hash_converts_to_key_type )
+{
+    safe_ptr<both> o = make_safe<both>();
+    safe_ptr<right_base> r = o;
+    BOOST_CHECK(static_cast<void*>(r.get()) != static_cast<void*>(o.get()));
+    BOOST_CHECK_EQUAL(ptr_hash<right_base>()(o), ptr_hash<right_base>()(r));
+    BOOST_CHECK(ptr_equal<right_base>()(o, r.get()));
+    BOOST_CHECK(ptr_equal<right_base>()(safe_ref<both>(o), std::shared_ptr<right_base>(r)));
+}
+
+#ifdef __cpp_lib_generic_unordered_lookup
+
+BOOST_AUTO_TEST_CASE( test_heterogeneous_lookup )
+{
+    std::unordered_set<safe_ptr<session>, ptr_hash<session>, ptr_equal<session> > live;
+    safe_ptr<session> a = make_safe<session>(1);
+    live.insert(a);
+    live.insert(make_safe<session>(2));
+
+    session* raw = a.get();
+    BOOST_CHECK(live.find(raw) != live.end());
+    BOOST_CHECK(live.find(safe_ref<session>(a)) != live.end());
+    BOOST_CHECK(live.contains(a));
+    session other(3);
+    BOOST_CHECK(live.find(&other) == live.end());
+    BOOST_CHECK_EQUAL(a.use_count(), 2);
+}
+
+#endif
+
+BOOST_AUTO_TEST_CASE( test_owner_functors )
+{
+    safe_ptr<both> o = make_safe<both>();
+    safe_ptr<left_base> l = o;
+    safe_ptr<right_base> r = o;
+    std::weak_ptr<both> w = o;
+    std::shared_ptr<session> other = std::make_shared<session>(4);
+
+    BOOST_CHECK(owner_equal()(l, r));
+    BOOST_CHECK(owner_equal()(w, r));
+    BOOST_CHECK(owner_equal()(r, std::shared_ptr<both>(o)));
+    BOOST_CHECK(!owner_equal()(other, r));
+    BOOST_CHECK(owner_less()(other, r) != owner_less()(r, other));
+    BOOST_CHECK(!l.owner_before(r) && !r.owner_before(l));
+
+    std::set<safe_ptr<left_base>, owner_less> owners;
+    owners.insert(l);
+    owners.insert(o);
+    BOOST_CHECK_EQUAL(owners.size(), 1u);
+}
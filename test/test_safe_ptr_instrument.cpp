@@ -0,0 +1,131 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE safe_ptr_instrument
+#include <boost/test/unit_test.hpp>
+
+#include "safe_ptr.hpp"
+#include "safe_ptr_instrument.hpp"
+
+#include <sstream>
+#include <thread>
+
+using namespace spl;
+
+namespace
+{
+
+struct shape
+{
+    virtual ~shape() {}
+};
+
+struct circle : shape
+{
+};
+
+struct account
+{
+};
+
+struct widget
+{
+    static safe_ptr<widget> make_safe()
+    {
+        return safe_ptr<widget>(new widget);
+    }
+};
+
+unsigned long long type_count(const instrument::snapshot& s, const std::string& type, instrument::event e)
+{
+    std::map<std::string, instrument::event_counts>::const_iterator i = s.types.find(type);
+    return i == s.types.end() ? 0 : i->second[e];
+}
+
+unsigned long long site_count(const instrument::snapshot& s, const std::string& site, instrument::event e)
+{
+    std::map<std::string, instrument::event_counts>::const_iterator i = s.sites.find(site);
+    return i == s.sites.end() ? 0 : i->second[e];
+}
+
+}
+
+BOOST_AUTO_TEST_CASE( test_instrument_counts_by_type )
+{
+    const std::string name = instrument::type_name<shape>();
+    instrument::snapshot before = instrument::take_thread_snapshot();
+
+    safe_ptr<shape> s = make_safe<circle>();
+    safe_ptr<shape> copy(s);
+    safe_ptr<shape> moved(std::move(copy));
+    safe_ptr<circle> c = dynamic_pointer_cast<circle>(s);
+    std::shared_ptr<shape> shared = s;
+    std::weak_ptr<shape> weak = s;
+    BOOST_CHECK_THROW(safe_ptr<shape>(static_cast<shape*>(0)), std::invalid_argument);
+
+    instrument::snapshot after = instrument::take_thread_snapshot();
+    BOOST_CHECK_EQUAL(type_count(after, name, instrument::copies) - type_count(before, name, instrument::copies), 1u);
+    BOOST_CHECK_EQUAL(type_count(after, name, instrument::shared_conversions) - type_count(before, name, instrument::shared_conversions), 1u);
+    BOOST_CHECK_EQUAL(type_count(after, name, instrument::weak_conversions) - type_count(before, name, instrument::weak_conversions), 1u);
+    BOOST_CHECK_EQUAL(type_count(after, name, instrument::null_throws) - type_count(before, name, instrument::null_throws), 1u);
+    BOOST_CHECK(type_count(after, name, instrument::moves) > type_count(before, name, instrument::moves));
+
+    const std::string circle_name = instrument::type_name<circle>();
+    BOOST_CHECK_EQUAL(type_count(after, circle_name, instrument::allocations) - type_count(before, circle_name, instrument::allocations), 1u);
+    BOOST_CHECK_EQUAL(type_count(after, circle_name, instrument::casts) - type_count(before, circle_name, instrument::casts), 1u);
+}
+
+BOOST_AUTO_TEST_CASE( test_instrument_counts_library_paths_only )
+{
+    const std::string name = instrument::type_name<account>();
+    const std::string widget_name = instrument::type_name<widget>();
+    instrument::snapshot before = instrument::take_thread_snapshot();
+
+    safe_ptr<account> a = make_safe<account>();
+    maybe_safe_ptr<account> m(a);
+    safe_ptr<widget> w = make_safe<widget>();
+    safe_ptr<widget> v = allocate_safe<widget>(std::allocator<widget>());
+
+    instrument::snapshot after = instrument::take_thread_snapshot();
+    BOOST_CHECK_EQUAL(type_count(after, name, instrument::allocations) - type_count(before, name, instrument::allocations), 1u);
+    BOOST_CHECK_EQUAL(type_count(after, name, instrument::shared_conversions) - type_count(before, name, instrument::shared_conversions), 0u);
+    // the hook allocates by itself
+    BOOST_CHECK_EQUAL(type_count(after, widget_name, instrument::allocations) - type_count(before, widget_name, instrument::allocations), 0u);
+}
+
+BOOST_AUTO_TEST_CASE( test_instrument_counts_by_site )
+{
+    safe_ptr<account> a = make_safe<account>();
+    {
+        SPL_INSTRUMENT_SCOPE("ledger.post");
+        for (int i = 0; i < 3; ++i)
+        {
+            safe_ptr<account> copy(a);
+        }
+    }
+    safe_ptr<account> outside(a);
+
+    instrument::snapshot s = instrument::take_thread_snapshot();
+    BOOST_CHECK_EQUAL(site_count(s, "ledger.post", instrument::copies), 3u);
+}
+
+BOOST_AUTO_TEST_CASE( test_instrument_keeps_exited_threads )
+{
+    const std::string name = instrument::type_name<account>();
+    safe_ptr<account> a = make_safe<account>();
+    unsigned long long before = type_count(instrument::take_snapshot(), name, instrument::copies);
+
+    std::thread worker([&a]() {
+        for (int i = 0; i < 5; ++i)
+        {
+            safe_ptr<account> copy(a);
+        }
+    });
+    worker.join();
+
+    instrument::snapshot s = instrument::take_snapshot();
+    BOOST_CHECK_EQUAL(type_count(s, name, instrument::copies) - before, 5u);
+
+    std::ostringstream out;
+    instrument::dump(out, s);
+    BOOST_CHECK_EQUAL(out.str().find("kind,name,event,count\n"), 0u);
+    BOOST_CHECK(out.str().find("type," + name + ",copy,") != std::string::npos);
+}
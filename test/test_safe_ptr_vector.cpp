@@ -0,0 +1,118 @@
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include "safe_ptr_vector.hpp"
+
+#include <algorithm>
+
+using namespace spl;
+
+namespace
+{
+
+struct order
+{
+    int price;
+    bool filled;
+
+    order(int p, bool f) : price(p), filled(f) {}
+};
+
+bool consistent(const safe_ptr_vector<order>& v)
+{
+    for (std::size_t i = 0; i < v.size(); ++i)
+        if (v.pointers()[i] != v[i].get())
+            return false;
+    return true;
+}
+
+}
+
+BOOST_AUTO_TEST_CASE( test_trivially_relocatable_trait )
+{
+    BOOST_CHECK(is_trivially_relocatable<safe_ptr<order> >::value);
+    BOOST_CHECK(is_trivially_relocatable<maybe_safe_ptr<order> >::value);
+    BOOST_CHECK(is_trivially_relocatable<order*>::value);
+    BOOST_CHECK(!is_trivially_relocatable<std::vector<int> >::value);
+}
+
+BOOST_AUTO_TEST_CASE( test_safe_ptr_vector_grows_without_touching_counts )
+{
+    safe_ptr<order> shared = make_safe<order>(0, false);
+    safe_ptr_vector<order> v;
+    for (int i = 0; i < 100; ++i)
+        v.push_back(shared);
+    BOOST_CHECK_EQUAL(v.size(), 100u);
+    BOOST_CHECK_EQUAL(shared.use_count(), 101);
+    BOOST_CHECK(consistent(v));
+
+    safe_ptr_vector<order> copy(v);
+    BOOST_CHECK_EQUAL(shared.use_count(), 201);
+    v.clear();
+    BOOST_CHECK_EQUAL(shared.use_count(), 101);
+    copy = safe_ptr_vector<order>();
+    BOOST_CHECK_EQUAL(shared.use_count(), 1);
+}
+
+BOOST_AUTO_TEST_CASE( test_safe_ptr_vector_insert_erase )
+{
+    safe_ptr_vector<order> v;
+    for (int i = 0; i < 5; ++i)
+        v.push_back(make_safe<order>(i, false));
+
+    safe_ptr<order> extra = make_safe<order>(42, false);
+    safe_ptr_vector<order>::iterator it = v.insert(v.begin() + 2, extra);
+    BOOST_CHECK(*it == extra);
+    BOOST_CHECK_EQUAL(v.size(), 6u);
+    BOOST_CHECK_EQUAL(v[2]->price, 42);
+    BOOST_CHECK_EQUAL(v[3]->price, 2);
+    BOOST_CHECK_EQUAL(extra.use_count(), 2);
+    BOOST_CHECK(consistent(v));
+
+    v.erase(v.begin() + 2);
+    BOOST_CHECK_EQUAL(extra.use_count(), 1);
+    v.erase(v.begin(), v.begin() + 2);
+    BOOST_CHECK_EQUAL(v.size(), 3u);
+    BOOST_CHECK_EQUAL(v.front()->price, 2);
+    BOOST_CHECK_EQUAL(v.back()->price, 4);
+    BOOST_CHECK(consistent(v));
+
+    v.set(1, extra);
+    BOOST_CHECK_EQUAL(v[1]->price, 42);
+    BOOST_CHECK(consistent(v));
+    BOOST_CHECK_THROW(v.at(3), std::out_of_range);
+
+    BOOST_CHECK_THROW(v.reserve(v.max_size() + 1), std::length_error);
+    BOOST_CHECK_EQUAL(v[1]->price, 42);
+    BOOST_CHECK(consistent(v));
+}
+
+BOOST_AUTO_TEST_CASE( test_safe_ptr_vector_sort_partition )
+{
+    safe_ptr_vector<order> v;
+    const int prices[] = { 5, 3, 9, 1, 7, 3 };
+    for (int i = 0; i < 6; ++i)
+        v.push_back(make_safe<order>(prices[i], prices[i] > 4));
+
+    v.sort([](const order& a, const order& b) { return a.price < b.price; });
+    for (std::size_t i = 1; i < v.size(); ++i)
+        BOOST_CHECK(v[i - 1]->price <= v[i]->price);
+    BOOST_CHECK(consistent(v));
+
+    std::size_t filled = v.partition([](const order& o) { return o.filled; });
+    BOOST_CHECK_EQUAL(filled, 3u);
+    BOOST_CHECK_EQUAL(v[0]->price, 5);
+    BOOST_CHECK_EQUAL(v[1]->price, 7);
+    BOOST_CHECK_EQUAL(v[2]->price, 9);
+    BOOST_CHECK_EQUAL(v[3]->price, 1);
+    BOOST_CHECK(consistent(v));
+
+    v.sort();
+    BOOST_CHECK(std::is_sorted(v.pointers(), v.pointers() + v.size()));
+    BOOST_CHECK(std::binary_search(v.pointers(), v.pointers() + v.size(), v[4].get()));
+    BOOST_CHECK(consistent(v));
+
+    BOOST_CHECK_THROW(v.sort([](const order&, const order&) -> bool { throw std::runtime_error("x"); }), std::runtime_error);
+    BOOST_CHECK(consistent(v));
+    BOOST_CHECK_EQUAL(v[0].use_count(), 1);
+}
@@ -0,0 +1,88 @@
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include "safe_reclaim.hpp"
+
+#include <thread>
+
+using namespace spl;
+
+namespace
+{
+
+struct tree
+{
+    static std::atomic<int> live;
+    std::thread::id* report;
+
+    explicit tree(std::thread::id* r = 0) : report(r) { ++live; }
+    ~tree()
+    {
+        if (report)
+            *report = std::this_thread::get_id();
+        --live;
+    }
+};
+
+std::atomic<int> tree::live(0);
+
+}
+
+BOOST_AUTO_TEST_CASE( test_make_safe_deferred_waits_for_drain )
+{
+    reclaim_queue queue;
+    {
+        safe_ptr<tree> t = make_safe_deferred<tree>(queue);
+        safe_ptr<tree> copy = t;
+        BOOST_CHECK(get_deleter<deferred_deleter<tree> >(t) != 0);
+        BOOST_CHECK(&get_deleter<deferred_deleter<tree> >(t)->queue() == &queue);
+    }
+    BOOST_CHECK_EQUAL(tree::live, 1);
+    BOOST_CHECK_EQUAL(queue.stats().depth, 1u);
+
+    BOOST_CHECK_EQUAL(queue.drain(), 1u);
+    BOOST_CHECK_EQUAL(tree::live, 0);
+    reclaim_stats stats = queue.stats();
+    BOOST_CHECK_EQUAL(stats.depth, 0u);
+    BOOST_CHECK_EQUAL(stats.deferred, 1u);
+    BOOST_CHECK_EQUAL(stats.reclaimed, 1u);
+    BOOST_CHECK_EQUAL(stats.batches, 1u);
+    BOOST_CHECK(stats.max_lag >= stats.last_lag);
+}
+
+BOOST_AUTO_TEST_CASE( test_deferred_deleter_with_constructor )
+{
+    reclaim_queue queue;
+    safe_ptr<tree>(new tree(), deferred_deleter<tree>(queue));
+    BOOST_CHECK(get_deleter<std::default_delete<tree> >(make_safe<tree>()) == 0);
+    BOOST_CHECK_EQUAL(queue.stats().depth, 1u);
+}
+
+BOOST_AUTO_TEST_CASE( test_reclaim_queue_backpressure )
+{
+    reclaim_queue queue(2);
+    for (int i = 0; i < 5; ++i)
+        make_safe_deferred<tree>(queue);
+    reclaim_stats stats = queue.stats();
+    BOOST_CHECK_EQUAL(stats.depth, 2u);
+    BOOST_CHECK_EQUAL(stats.max_depth, 2u);
+    BOOST_CHECK_EQUAL(stats.inline_reclaims, 3u);
+    BOOST_CHECK_EQUAL(tree::live, 2);
+    queue.drain();
+    BOOST_CHECK_EQUAL(tree::live, 0);
+}
+
+BOOST_AUTO_TEST_CASE( test_reclaim_thread_destroys_off_thread )
+{
+    reclaim_queue queue(1024, 4);
+    std::thread::id destroyed_on;
+    {
+        reclaim_thread reclaimer(queue, std::chrono::milliseconds(1));
+        make_safe_deferred<tree>(queue, &destroyed_on);
+        for (int i = 0; i < 100 && tree::live != 0; ++i)
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        BOOST_CHECK_EQUAL(tree::live, 0);
+    }
+    BOOST_CHECK(destroyed_on != std::thread::id());
+    BOOST_CHECK(destroyed_on != std::this_thread::get_id());
+}
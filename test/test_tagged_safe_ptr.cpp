@@ -0,0 +1,84 @@
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include "tagged_safe_ptr.hpp"
+
+using namespace spl;
+
+namespace
+{
+
+enum side { buy = 0, sell = 1, cancel = 2 };
+
+struct quote
+{
+    virtual ~quote() {}
+    long price;
+};
+
+struct firm_quote : quote
+{
+    long size;
+};
+
+struct level
+{
+    tagged_safe_ptr<quote, 2> best;
+    level(const safe_ptr<quote>& q, side s) : best(q, s) {}
+};
+
+}
+
+BOOST_AUTO_TEST_CASE( test_tagged_safe_ptr_is_two_words )
+{
+    BOOST_CHECK_EQUAL(sizeof(tagged_safe_ptr<quote, 2>), sizeof(safe_ptr<quote>));
+    BOOST_CHECK_EQUAL(sizeof(level), 2 * sizeof(void*));
+}
+
+BOOST_AUTO_TEST_CASE( test_tagged_safe_ptr_tag )
+{
+    safe_ptr<quote> q = make_safe<firm_quote>();
+    q->price = 100;
+    tagged_safe_ptr<quote, 2> t(q, sell);
+    BOOST_CHECK(t.get() == q.get());
+    BOOST_CHECK_EQUAL(t->price, 100);
+    BOOST_CHECK_EQUAL(t.tag(), unsigned(sell));
+    BOOST_CHECK_EQUAL(q.use_count(), 2);
+
+    tagged_safe_ptr<quote, 2> copy = t;
+    BOOST_CHECK_EQUAL(copy.tag(), unsigned(sell));
+    copy.set_tag(cancel);
+    BOOST_CHECK_EQUAL(copy.tag(), unsigned(cancel));
+    BOOST_CHECK_EQUAL(t.tag(), unsigned(sell));
+    BOOST_CHECK(copy == t);
+    BOOST_CHECK_EQUAL(q.use_count(), 3);
+
+    safe_ptr<quote> back = copy;
+    BOOST_CHECK(back == q);
+    BOOST_CHECK_EQUAL(q.use_count(), 4);
+    safe_ptr<quote> moved = std::move(copy);
+    BOOST_CHECK(moved == q);
+    BOOST_CHECK_EQUAL(q.use_count(), 4);
+}
+
+BOOST_AUTO_TEST_CASE( test_tagged_safe_ptr_casts_keep_tag )
+{
+    safe_ptr<firm_quote> f = make_safe<firm_quote>();
+    tagged_safe_ptr<quote, 2> t(f, buy);
+    t.set_tag(sell);
+
+    tagged_safe_ptr<firm_quote, 2> down = dynamic_pointer_cast<firm_quote>(t);
+    BOOST_CHECK(down.get() == f.get());
+    BOOST_CHECK_EQUAL(down.tag(), unsigned(sell));
+
+    tagged_safe_ptr<quote, 2> up = down;
+    BOOST_CHECK_EQUAL(up.tag(), unsigned(sell));
+
+    tagged_safe_ptr<const quote, 2> c = static_pointer_cast<const quote>(std::move(up));
+    BOOST_CHECK_EQUAL(c.tag(), unsigned(sell));
+    BOOST_CHECK(c.get() == f.get());
+
+    tagged_safe_ptr<quote, 2> plain(make_safe<quote>(), cancel);
+    BOOST_CHECK_THROW(dynamic_pointer_cast<firm_quote>(plain), std::bad_cast);
+    BOOST_CHECK_EQUAL(plain.tag(), unsigned(cancel));
+}
@@ -0,0 +1,105 @@
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include "unique_safe_ptr.hpp"
+
+#include <vector>
+
+using namespace spl;
+
+namespace
+{
+
+struct shape
+{
+  virtual ~shape() {}
+  virtual int sides() const = 0;
+};
+
+struct square : shape, enable_safe_from_this<square>
+{
+  static int alive;
+  int size;
+
+  square() : size(1) { ++alive; }
+  explicit square(int s) : size(s) { ++alive; }
+  ~square() { --alive; }
+  int sides() const { return 4; }
+};
+
+int square::alive = 0;
+
+struct ticket
+{
+  static int issued;
+  int number;
+
+  explicit ticket(int n) : number(n) {}
+
+  static unique_safe_ptr<ticket> make_unique_safe(int n)
+  {
+    ++issued;
+    return unique_safe_ptr<ticket>(new ticket(n + 1000));
+  }
+};
+
+int ticket::issued = 0;
+
+}
+
+BOOST_AUTO_TEST_CASE( test_unique_safe_ptr )
+{
+  BOOST_CHECK_EQUAL(sizeof(unique_safe_ptr<square>), sizeof(square*));
+  BOOST_CHECK(!std::is_copy_constructible<unique_safe_ptr<square> >::value);
+  BOOST_CHECK(!std::is_copy_assignable<unique_safe_ptr<square> >::value);
+  BOOST_CHECK(std::is_nothrow_move_constructible<unique_safe_ptr<square> >::value);
+  {
+    unique_safe_ptr<square> s = make_unique_safe<square>(3);
+    BOOST_CHECK_EQUAL(s->size, 3);
+    unique_safe_ptr<square> d;
+    BOOST_CHECK_EQUAL(d->size, 1);
+    BOOST_CHECK_EQUAL(square::alive, 2);
+
+    unique_safe_ptr<shape> b(std::move(s));
+    BOOST_CHECK_EQUAL(b->sides(), 4);
+    b = std::move(d);
+    BOOST_CHECK_EQUAL(square::alive, 1);
+
+    std::vector<unique_safe_ptr<shape> > v;
+    v.push_back(std::move(b));
+    v.push_back(make_unique_safe<square>(5));
+    BOOST_CHECK_EQUAL(square::alive, 2);
+
+    BOOST_CHECK(v[0] != v[1]);
+    BOOST_CHECK_EQUAL(v[0] < v[1], v[1] > v[0]);
+    BOOST_CHECK_EQUAL(v[0] <= v[1], !(v[0] >= v[1]));
+
+    std::unique_ptr<shape> u = std::move(v[1]).into_unique();
+    BOOST_CHECK_EQUAL(static_cast<square&>(*u).size, 5);
+  }
+  BOOST_CHECK_EQUAL(square::alive, 0);
+
+  BOOST_CHECK_THROW(unique_safe_ptr<square>(static_cast<square*>(0)), std::invalid_argument);
+  BOOST_CHECK_THROW(unique_safe_ptr<square>(std::unique_ptr<square>()), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE( test_unique_safe_ptr_to_safe_ptr )
+{
+  unique_safe_ptr<square> u = make_unique_safe<square>(2);
+  square* raw = u.get();
+  safe_ptr<square> s = std::move(u);
+  BOOST_CHECK(s.get() == raw);
+  BOOST_CHECK_EQUAL(s.use_count(), 1);
+  BOOST_CHECK(s->safe_from_this() == s);
+
+  safe_ptr<shape> b = make_unique_safe<square>(6);
+  BOOST_CHECK_EQUAL(b->sides(), 4);
+  BOOST_CHECK_EQUAL(square::alive, 2);
+}
+
+BOOST_AUTO_TEST_CASE( test_make_unique_safe_hook )
+{
+  unique_safe_ptr<ticket> t = make_unique_safe<ticket>(7);
+  BOOST_CHECK_EQUAL(t->number, 1007);
+  BOOST_CHECK_EQUAL(ticket::issued, 1);
+}
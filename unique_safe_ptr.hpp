@@ -0,0 +1,269 @@
+#pragma once
+
+#include "safe_ptr.hpp"
+
+namespace spl
+{
+
+template<typename T> class unique_safe_ptr;
+
+namespace detail
+{
+    struct unique_safe_ptr_access
+    {
+        template<typename T>
+        static unique_safe_ptr<T> adopt(T* p) noexcept
+        {
+            return unique_safe_ptr<T>(p, unchecked_tag());
+        }
+    };
+
+    template<typename Void, typename T, typename... Args>
+    struct has_make_unique_safe_impl : std::false_type
+    {
+    };
+
+    template<typename T, typename... Args>
+    struct has_make_unique_safe_impl<typename make_void<decltype(T::make_unique_safe(forward_type<Args>()...))>::type, T, Args...>
+        : std::true_type
+    {
+        static_assert(std::is_same<decltype(T::make_unique_safe(forward_type<Args>()...)), unique_safe_ptr<T> >::value,
+            "make_unique_safe should return a unique_safe_ptr");
+    };
+
+    template<typename T, typename... Args>
+    struct has_make_unique_safe : has_make_unique_safe_impl<void, T, Args...>
+    {
+    };
+}
+
+//
+// unique_safe_ptr
+//
+// The single-owner counterpart of safe_ptr: never null, move-only, and a
+// single pointer wide, with no control block and no reference count. For
+// objects that only ever have one owner, and for building an object before
+// it is shared. Moving from an rvalue into a safe_ptr allocates the control
+// block at that point; the pointer is not checked for null again.
+//
+// As with safe_ptr, a moved-from unique_safe_ptr holds null and may only be
+// destroyed, assigned to or swapped.
+//
+
+template<typename T>
+class unique_safe_ptr
+{
+    template <typename> friend class unique_safe_ptr;
+    friend struct detail::unique_safe_ptr_access;
+public:
+    typedef T  element_type;
+
+    unique_safe_ptr(); // will construct new T object using make_unique_safe<T>()
+
+    template<typename U>
+    explicit unique_safe_ptr(U* p, typename std::enable_if<std::is_convertible<U*, T*>::value, void*>::type = 0)
+        : p_(p)
+    {
+        if (!p)
+            throw std::invalid_argument("p");
+    }
+
+    template<typename U>
+    explicit unique_safe_ptr(std::unique_ptr<U>&& p, typename std::enable_if<std::is_convertible<U*, T*>::value, void*>::type = 0)
+        : p_(p.get())
+    {
+        if (!p)
+            throw std::invalid_argument("p");
+        p.release();
+    }
+
+    unique_safe_ptr(const unique_safe_ptr&) = delete;
+    unique_safe_ptr& operator=(const unique_safe_ptr&) = delete;
+
+    unique_safe_ptr(unique_safe_ptr&& other) noexcept
+        : p_(other.p_)
+    {
+        other.p_ = 0;
+    }
+
+    template<typename U>
+    unique_safe_ptr(unique_safe_ptr<U>&& other, typename std::enable_if<std::is_convertible<U*, T*>::value, void*>::type = 0) noexcept
+        : p_(other.p_)
+    {
+        other.p_ = 0;
+    }
+
+    ~unique_safe_ptr()
+    {
+        delete p_;
+    }
+
+    unique_safe_ptr& operator=(unique_safe_ptr&& other) noexcept
+    {
+        unique_safe_ptr(std::move(other)).swap(*this);
+        return *this;
+    }
+
+    template<typename U>
+    typename std::enable_if<std::is_convertible<U*, T*>::value, unique_safe_ptr&>::type operator=(unique_safe_ptr<U>&& other) noexcept
+    {
+        unique_safe_ptr(std::move(other)).swap(*this);
+        return *this;
+    }
+
+    T& operator*() const
+    {
+        return *get();
+    }
+
+    T* operator->() const
+    {
+        return get();
+    }
+
+    T* get() const
+    {
+        assert(p_ && "use of moved-from unique_safe_ptr");
+        return p_;
+    }
+
+    void swap(unique_safe_ptr& other) noexcept
+    {
+        std::swap(p_, other.p_);
+    }
+
+    // Gives up ownership, leaving *this moved-from.
+    std::unique_ptr<T> into_unique() &&
+    {
+        assert(p_ && "use of moved-from unique_safe_ptr");
+        T* p = p_;
+        p_ = 0;
+        return std::unique_ptr<T>(p);
+    }
+
+    // Shares the object. If allocating the control block throws, *this
+    // still owns it.
+    template<typename U, typename = typename std::enable_if<std::is_convertible<T*, U*>::value>::type>
+    operator safe_ptr<U>() &&
+    {
+        assert(p_ && "use of moved-from unique_safe_ptr");
+        std::unique_ptr<T> owner(p_);
+        p_ = 0;
+        try
+        {
+            return detail::safe_ptr_access::adopt(std::shared_ptr<U>(std::move(owner)));
+        }
+        catch (...)
+        {
+            p_ = owner.release();
+            throw;
+        }
+    }
+
+private:
+    unique_safe_ptr(T* p, detail::unchecked_tag) noexcept
+        : p_(p)
+    {
+    }
+
+    T* p_;
+};
+
+template<class T, class U>
+bool operator==(const unique_safe_ptr<T>& a, const unique_safe_ptr<U>& b)
+{
+    return a.get() == b.get();
+}
+
+template<class T, class U>
+bool operator!=(const unique_safe_ptr<T>& a, const unique_safe_ptr<U>& b)
+{
+    return a.get() != b.get();
+}
+
+template<class T, class U>
+bool operator<(const unique_safe_ptr<T>& a, const unique_safe_ptr<U>& b)
+{
+    return a.get() < b.get();
+}
+
+template<class T, class U>
+bool operator>(const unique_safe_ptr<T>& a, const unique_safe_ptr<U>& b)
+{
+    return a.get() > b.get();
+}
+
+template<class T, class U>
+bool operator>=(const unique_safe_ptr<T>& a, const unique_safe_ptr<U>& b)
+{
+    return a.get() >= b.get();
+}
+
+template<class T, class U>
+bool operator<=(const unique_safe_ptr<T>& a, const unique_safe_ptr<U>& b)
+{
+    return a.get() <= b.get();
+}
+
+template<class E, class T, class U>
+std::basic_ostream<E, T>& operator<<(std::basic_ostream<E, T>& out, const unique_safe_ptr<U>& p)
+{
+    return out << p.get();
+}
+
+template<class T>
+void swap(unique_safe_ptr<T>& a, unique_safe_ptr<T>& b) noexcept
+{
+    a.swap(b);
+}
+
+template<class T>
+T* get_pointer(unique_safe_ptr<T> const& p)
+{
+    return p.get();
+}
+
+template<typename T>
+struct is_trivially_relocatable<unique_safe_ptr<T> > : std::true_type
+{
+};
+
+namespace detail
+{
+    // T::make_unique_safe exists
+    template<typename T, typename... Args>
+    unique_safe_ptr<T> make_unique_safe(std::true_type, Args&&... args)
+    {
+        return T::make_unique_safe(std::forward<Args>(args)...);
+    }
+
+    template<typename T, typename... Args>
+    unique_safe_ptr<T> make_unique_safe(std::false_type, Args&&... args)
+    {
+        return unique_safe_ptr_access::adopt(new T(std::forward<Args>(args)...));
+    }
+}
+
+//
+// make_unique_safe
+//
+// unique_safe_ptr equivalent to make_unique. A class can take over
+// construction with a static T::make_unique_safe(args...), the counterpart
+// of T::make_safe; a T::make_safe hook alone is not used, since it returns
+// a shared object.
+//
+
+template<typename T, typename... Args>
+unique_safe_ptr<T> make_unique_safe(Args&&... args)
+{
+    return detail::make_unique_safe<T>(detail::has_make_unique_safe<T, Args...>(), std::forward<Args>(args)...);
+}
+
+template<typename T>
+unique_safe_ptr<T>::unique_safe_ptr()
+    : p_(0)
+{
+    make_unique_safe<T>().swap(*this);
+}
+
+} // namespace